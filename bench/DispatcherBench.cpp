@@ -0,0 +1,182 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Measures the time from InvokeAsync() to the function running, in each DispatchQueueMode:
+// waking an idle dispatcher from another thread, passing a request back and forth between
+// two dispatchers, and a dispatcher posting to itself. From this directory, with clang:
+//
+//   clang++ -std=c++17 -fcoroutines-ts -stdlib=libc++ -O2 -I../source DispatcherBench.cpp
+//       ../source/system/MemoryPool.cpp ../source/system/TimingWheel.cpp
+//       ../source/system/WakeEvent.cpp ../source/system/Console.cpp -lpthread -o DispatcherBench
+
+#include <system/Dispatcher.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    constexpr int WakeSamples = 2000;
+    constexpr int RoundTrips = 200000;
+    constexpr int LocalPosts = 1000000;
+
+    int64_t Now() {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // a dispatcher running on its own thread
+    class DispatcherThread
+    {
+    public:
+        DispatcherThread()
+        {
+            promise<Dispatcher*> started;
+            auto future = started.get_future();
+
+            thread = std::thread([&started] {
+                started.set_value(&Dispatcher::current());
+                Dispatcher::current().Run();
+            });
+
+            dispatcher = future.get();
+        }
+
+        ~DispatcherThread()
+        {
+            dispatcher->Quit();
+            thread.join();
+        }
+
+        Dispatcher* dispatcher;
+
+    private:
+        std::thread thread;
+    };
+
+    // an idle dispatcher is sent one request at a time from a thread that isn't a dispatcher
+    void MeasureWake()
+    {
+        DispatcherThread target;
+        atomic<int64_t> ranAt = 0;
+        vector<int64_t> latencies;
+
+        for(int i = 0; i < WakeSamples; ++i)
+        {
+            // long enough for the dispatcher to go back to waiting
+            this_thread::sleep_for(microseconds(500));
+
+            ranAt = 0;
+            int64_t postedAt = Now();
+
+            target.dispatcher->InvokeAsync([](void* ranAt, intmax_t) {
+                ((atomic<int64_t>*)ranAt)->store(Now());
+            }, &ranAt);
+
+            while(ranAt == 0)
+                this_thread::yield();
+
+            latencies.push_back(ranAt - postedAt);
+        }
+
+        sort(latencies.begin(), latencies.end());
+        printf("  wake idle dispatcher: median %6.0f ns, p99 %6.0f ns\n",
+            (double)latencies[latencies.size() / 2], (double)latencies[latencies.size() * 99 / 100]);
+    }
+
+    struct PingPong
+    {
+        Dispatcher* a;
+        Dispatcher* b;
+        int remaining;
+        promise<void> done = {};
+    };
+
+    void Pong(void* ptr, intmax_t);
+
+    // runs on 'b'
+    void Ping(void* ptr, intmax_t) {
+        ((PingPong*)ptr)->a->InvokeAsync(&Pong, ptr);
+    }
+
+    // runs on 'a'
+    void Pong(void* ptr, intmax_t)
+    {
+        auto pingPong = (PingPong*)ptr;
+
+        if(--pingPong->remaining == 0)
+            pingPong->done.set_value();
+        else
+            pingPong->b->InvokeAsync(&Ping, ptr);
+    }
+
+    // two dispatchers pass one request back and forth
+    void MeasurePingPong()
+    {
+        DispatcherThread a, b;
+        PingPong pingPong{ a.dispatcher, b.dispatcher, RoundTrips };
+        auto done = pingPong.done.get_future();
+
+        auto start = steady_clock::now();
+        b.dispatcher->InvokeAsync(&Ping, &pingPong);
+        done.wait();
+
+        double ns = duration<double, nano>(steady_clock::now() - start).count();
+        printf("  ping-pong between two dispatchers: %6.0f ns per hop\n", ns / (RoundTrips * 2.0));
+    }
+
+    struct LocalChain
+    {
+        int remaining;
+        promise<void> done = {};
+    };
+
+    void PostNext(void* ptr, intmax_t)
+    {
+        auto chain = (LocalChain*)ptr;
+
+        if(--chain->remaining == 0)
+            chain->done.set_value();
+        else
+            Dispatcher::current().InvokeAsync(&PostNext, ptr);
+    }
+
+    // each request posts the next one to its own dispatcher
+    void MeasureLocal()
+    {
+        DispatcherThread target;
+        LocalChain chain{ LocalPosts };
+        auto done = chain.done.get_future();
+
+        auto start = steady_clock::now();
+        target.dispatcher->InvokeAsync(&PostNext, &chain);
+        done.wait();
+
+        double ns = duration<double, nano>(steady_clock::now() - start).count();
+        printf("  dispatcher posting to itself:      %6.1f ns per request\n", ns / LocalPosts);
+    }
+}
+
+int main()
+{
+    for(auto mode : { DispatchQueueMode::Locked, DispatchQueueMode::LockFree })
+    {
+        // applies to the dispatchers of the threads started after this
+        Dispatcher::SetDefaultQueueMode(mode);
+        printf("%s\n", mode == DispatchQueueMode::Locked ? "Locked" : "LockFree");
+
+        MeasureWake();
+        MeasurePingPong();
+        MeasureLocal();
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Measures how fast response headers are generated, compared to the stringstream based
+// serializer they replaced. The header is the one the server sends for a range request.
+// From this directory:
+//
+//   g++ -std=c++17 -O2 -I../source HttpHeaderBench.cpp ../source/net/http/Http.cpp
+//       ../source/net/http/HttpFields.cpp ../source/net/http/HttpScan.cpp
+//       ../source/net/http/HttpCommonFields.cpp -o HttpHeaderBench
+
+#include <net/http/Http.h>
+#include <net/http/HttpCommonFields.h>
+#include <system/format.h>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    constexpr int Iterations = 1000000;
+    constexpr uint64_t FileSize = 20000000;
+    constexpr uint64_t RangeSize = 1024;
+
+    // HttpResponse::SerializeHeader() as it was before it wrote into the buffer directly
+    void StreamSerialize(const HttpResponse& resp, vector<char>& buffer)
+    {
+        stringstream response;
+        response << std::noskipws;
+        response << "HTTP/" << resp.version << " " << "206" << " " << "Partial Content" << "\r\n";
+
+        for(auto& field : resp.fields)
+            response << field.name << ": " << field.value << "\r\n";
+
+        response << "\r\n";
+
+        size_t headerSize = (size_t)response.tellp();
+        buffer.clear();
+        buffer.resize(headerSize);
+
+        response.seekg(0, ios::beg);
+        response.read(buffer.data(), headerSize);
+    }
+
+    HttpResponse RangeResponse()
+    {
+        HttpResponse resp;
+        resp.status = HttpStatus::PartialContent;
+        resp.fields.Set(HttpField::ContentType, "image/jpeg");
+        resp.fields.Set(HttpField::ContentEncoding, "identity");
+        resp.fields.Set(HttpField::Connection, "keep-alive");
+        resp.fields.Set(HttpField::AcceptRanges, "bytes");
+        return resp;
+    }
+
+    // sets the fields that change per request, then serializes the header
+    template<class Serialize>
+    void Run(const char* name, bool setFields, Serialize serialize)
+    {
+        HttpResponse resp = RangeResponse();
+        vector<char> header;
+        size_t bytes = 0;
+
+        auto start = steady_clock::now();
+
+        for(int i = 0; i < Iterations; ++i)
+        {
+            if(setFields || i == 0)
+            {
+                uint64_t first = (uint64_t)i * 4096 % FileSize;
+                serialize.SetRange(resp, first, first + RangeSize - 1);
+            }
+
+            serialize(resp, header);
+            bytes += header.size();
+        }
+
+        double seconds = duration<double>(steady_clock::now() - start).count();
+        printf("%-32s %4.0f ns/header, %3zu B each, %5.0f MB/s\n",
+            name, seconds * 1e9 / Iterations, header.size(), bytes / seconds / 1e6);
+    }
+
+    struct Streams
+    {
+        void SetRange(HttpResponse& resp, uint64_t first, uint64_t last)
+        {
+            resp.fields.Set(HttpField::ContentLength, to_string(RangeSize));
+            resp.fields.Set(HttpField::ContentRange, format("bytes %-%/%", first, last, FileSize));
+        }
+
+        void operator()(const HttpResponse& resp, vector<char>& header) {
+            StreamSerialize(resp, header);
+        }
+    };
+
+    struct Direct
+    {
+        string_view commonFields;
+
+        void SetRange(HttpResponse& resp, uint64_t first, uint64_t last)
+        {
+            char range[Http::MaxContentRangeSize];
+            resp.fields.Set(HttpField::ContentLength, RangeSize);
+            resp.fields.Set(HttpField::ContentRange, string(range, Http::FormatContentRange(range, first, last, FileSize)));
+        }
+
+        void operator()(HttpResponse& resp, vector<char>& header) {
+            resp.SerializeHeader(header, commonFields);
+        }
+    };
+}
+
+int main()
+{
+    HttpCommonFields commonFields;
+
+    Run("streams, set fields + serialize", true, Streams());
+    Run("direct, set fields + serialize", true, Direct());
+    Run("streams, serialize", false, Streams());
+    Run("direct, serialize", false, Direct());
+    Run("direct, serialize + Date/Server", false, Direct{ commonFields.block() });
+    return 0;
+}
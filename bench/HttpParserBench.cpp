@@ -0,0 +1,227 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Compares the in-place request parser with the regex based one it replaced, on headers
+// like the ones browsers send, with each instruction set the CPU supports. From this directory:
+//
+//   g++ -std=c++17 -O2 -I../source HttpParserBench.cpp ../source/net/http/Http.cpp
+//       ../source/net/http/HttpFields.cpp ../source/net/http/HttpScan.cpp -o HttpParserBench
+
+#include <net/http/Http.h>
+#include <net/http/HttpScan.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    // HttpRequest::Parse() as it was before the in-place parser
+    struct RegexRequest
+    {
+        string method;
+        string uri;
+        string version;
+        multimap<string, string> fields;
+    };
+
+    vector<string> Split(const string& str, const string& delim)
+    {
+        vector<string> parts;
+        size_t start = 0;
+
+        for(size_t end; (end = str.find(delim, start)) != string::npos; start = end + delim.size())
+            parts.push_back(str.substr(start, end - start));
+
+        parts.push_back(str.substr(start));
+        return parts;
+    }
+
+    bool RegexParse(const string& request, RegexRequest& req)
+    {
+        auto end = strstr(request.c_str(), "\r\n\r\n");
+        if(end == nullptr)
+            return false;
+
+        string header(request.c_str(), end - request.c_str());
+
+        vector<string> lines = Split(header, "\r\n");
+        if(lines.empty())
+            return false;
+
+        regex lineReg("(CONNECT|DELETE|GET|HEAD|OPTIONS|POST|PUT|TRACE) (.+) HTTP/(.+)");
+        smatch match;
+
+        if(!regex_search(lines[0], match, lineReg) || match.size() != 4)
+            return false;
+
+        req.method = match[1];
+        req.uri = match[2];
+        req.version = match[3];
+        req.fields.clear();
+
+        for(size_t i = 1; i < lines.size(); ++i)
+        {
+            regex fieldReg("\\s*(.+)\\s*:\\s*(.+)\\s*");
+
+            if(!regex_search(lines[i], match, fieldReg))
+                return false;
+
+            req.fields.emplace(match[1], match[2]);
+        }
+
+        return true;
+    }
+
+    const string Chrome =
+        "GET /images/photos/2019/summer/beach-sunset.jpg?size=large&v=3 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+        "sec-ch-ua-platform: \"Windows\"\r\n"
+        "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Dest: image\r\n"
+        "Referer: https://www.example.com/gallery/summer.html\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+        "Cookie: _ga=GA1.2.1234567890.1600000000; session=abcdef0123456789abcdef0123456789; theme=dark\r\n"
+        "If-None-Match: \"5d8c72a5edda8\"\r\n"
+        "If-Modified-Since: Tue, 15 Oct 2019 12:45:26 GMT\r\n"
+        "\r\n";
+
+    const string Firefox =
+        "GET / HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: none\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "\r\n";
+
+    // a request through a CDN, with a large cookie and forwarded fields
+    string ProxiedRequest()
+    {
+        string cookie = "Cookie: ";
+        for(int i = 0; i < 60; ++i)
+            cookie += "tracking_id_" + to_string(i) + "=0123456789abcdef0123456789abcdef0123456789; ";
+        cookie += "end=1\r\n";
+
+        string request = Chrome;
+        request.insert(request.size() - 2, cookie);
+
+        for(int i = 0; i < 20; ++i)
+            request.insert(request.size() - 2, "X-Forwarded-Custom-Header-" + to_string(i) + ": some-value-that-is-moderately-long-" + to_string(i) + "\r\n");
+
+        return request;
+    }
+
+    template<class Parse>
+    double Measure(int count, Parse parse)
+    {
+        auto start = steady_clock::now();
+
+        for(int i = 0; i < count; ++i)
+        {
+            if(!parse()) {
+                printf("failed to parse\n");
+                exit(1);
+            }
+        }
+
+        return duration<double, nano>(steady_clock::now() - start).count() / count;
+    }
+
+    // the in-place parser, and the incremental parser as the server uses it, with reads as
+    // large as the parser's buffer allows. Returns the field count.
+    size_t RunLevel(const char* levelName, const string& request, int count, double regexTime)
+    {
+        HttpRequestView view;
+        HttpRequestParser parser;
+
+        double viewTime = Measure(count, [&] {
+            return view.Parse(request.data(), request.size());
+        });
+
+        double parserTime = Measure(count, [&] {
+            auto result = HttpRequestParser::Result::Incomplete;
+
+            for(size_t offset = 0; result == HttpRequestParser::Result::Incomplete && offset < request.size(); )
+            {
+                size_t space;
+                char* buffer = parser.Prepare(space);
+                size_t size = std::min(space, request.size() - offset);
+
+                memcpy(buffer, request.data() + offset, size);
+                offset += size;
+                result = parser.Commit(size);
+            }
+
+            parser.Next();
+            return result == HttpRequestParser::Result::Complete;
+        });
+
+        printf("  %-7s in place %5.0f ns (%4.0fx, %5.0f MB/s)   incremental %5.0f ns\n",
+            levelName, viewTime, regexTime / viewTime, request.size() / viewTime * 1000.0, parserTime);
+
+        return view.fields.size();
+    }
+
+    void Run(const char* name, const string& request, int count)
+    {
+        RegexRequest regexReq;
+
+        // thousands of times slower, so it gets fewer runs
+        double regexTime = Measure(count / 5000, [&] {
+            return RegexParse(request, regexReq);
+        });
+
+        printf("%s, %zu B, %zu fields: regex %.0f ns\n", name, request.size(), regexReq.fields.size(), regexTime);
+
+        // each instruction set the CPU supports
+        const pair<Http::ScanLevel, const char*> levels[] = {
+            { Http::ScanLevel::Scalar, "scalar" },
+            { Http::ScanLevel::SSE42, "SSE4.2" },
+            { Http::ScanLevel::AVX2, "AVX2" }
+        };
+
+        for(auto [level, levelName] : levels)
+        {
+            if(Http::SetScanLevel(level) != level)
+                break;
+
+            if(RunLevel(levelName, request, count, regexTime) != regexReq.fields.size()) {
+                printf("%s: the parsers disagree\n", name);
+                exit(1);
+            }
+        }
+    }
+}
+
+int main()
+{
+    Run("chrome", Chrome, 1000000);
+    Run("firefox", Firefox, 1000000);
+    Run("proxied", ProxiedRequest(), 200000);
+    return 0;
+}
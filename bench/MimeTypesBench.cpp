@@ -0,0 +1,103 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Compares MimeTypes lookups with the map it replaced, for paths with common and uncommon
+// extensions, counting allocations. From this directory:
+//
+//   g++ -std=c++17 -O2 -I../source -I../test MimeTypesBench.cpp ../source/net/http/MimeTypes.cpp
+//       ../source/net/http/HttpFields.cpp -o MimeTypesBench
+
+#include <net/http/MimeTypes.h>
+#include <OldMimeTypes.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace
+{
+    size_t allocations = 0;
+}
+
+void* operator new(size_t size)
+{
+    ++allocations;
+
+    if(void* block = malloc(size))
+        return block;
+
+    throw bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+namespace
+{
+    constexpr int Rounds = 2000;
+
+    template<class Lookup>
+    void Run(const char* name, const vector<string>& paths, Lookup lookup)
+    {
+        size_t total = 0;
+        size_t allocationsBefore = allocations;
+        auto start = steady_clock::now();
+
+        for(int r = 0; r < Rounds; ++r)
+        {
+            for(auto& path : paths)
+                total += lookup(path).size();
+        }
+
+        double count = (double)Rounds * paths.size();
+        double ns = duration<double, nano>(steady_clock::now() - start).count() / count;
+        printf("%-28s %5.1f ns/lookup, %.2f allocations/lookup (%zu)\n",
+            name, ns, (allocations - allocationsBefore) / count, total);
+    }
+}
+
+int main()
+{
+    size_t allocationsBefore = allocations;
+    OldMimeTypes::TypeFor("jpg");
+    printf("old map, first lookup: %zu allocations\n", allocations - allocationsBefore);
+
+    vector<string> extensions;
+    for(auto& entry : OldMimeTypes().types)
+        extensions.push_back(entry.first);
+
+    // half of the requests are for common types
+    const char* common[] = { "html", "jpg", "png", "css", "js", "ico", "gif", "svg", "woff2", "json" };
+
+    vector<string> paths;
+    for(int i = 0; i < 1000; ++i)
+        paths.push_back("/var/www/httpdocs/images/file" + to_string(i) + "." + (i % 2 ? common[i % 10] : extensions[i * 7 % extensions.size()]));
+
+    // as the server used it
+    Run("old, substr + map", paths, [](const string& path) -> const string& {
+        return OldMimeTypes::TypeFor(path.substr(path.find_last_of('.') + 1));
+    });
+
+    Run("new, TypeForPath", paths, [](const string& path) {
+        return MimeTypes::TypeForPath(path);
+    });
+
+    Run("new, TypeFor", paths, [](const string& path) {
+        string_view extension = path;
+        return MimeTypes::TypeFor(extension.substr(extension.find_last_of('.') + 1));
+    });
+
+    return 0;
+}
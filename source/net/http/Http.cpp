@@ -4,62 +4,68 @@
 *--------------------------------------------------------------------------------------------*/
 
 #include <net/http/Http.h>
+#include <net/http/HttpScan.h>
+#include <cstring>
+#include <charconv>
 
 using namespace std;
 
-struct EnumClassHash
+struct StatusInfo
 {
-    template <typename T>
-    auto operator()(T t) const {
-        return static_cast<typename std::underlying_type<T>::type>(t);
-    }
+    string_view code;
+    string_view reason;
+    string_view line; // the HTTP/1.1 status line, with its CRLF
 };
 
-const unordered_map<HttpStatus, string, EnumClassHash> statusCodes =
+// indexed by HttpStatus
+constexpr StatusInfo statuses[] =
 {
-    { HttpStatus::NotSet, "0" },
-    { HttpStatus::Continue, "100" },
-    { HttpStatus::SwitchingProtocols, "101" },
-    { HttpStatus::OK, "200" },
-    { HttpStatus::Created, "201" },
-    { HttpStatus::Accepted, "202" },
-    { HttpStatus::NonAuthoritativeInformation, "203" },
-    { HttpStatus::NoContent, "204" },
-    { HttpStatus::ResetContent, "205" },
-    { HttpStatus::PartialContent, "206" },
-    { HttpStatus::MultipleChoices, "300" },
-    { HttpStatus::MovedPermanently, "301" },
-    { HttpStatus::Found, "302" },
-    { HttpStatus::SeeOther, "303" },
-    { HttpStatus::NotModified, "304" },
-    { HttpStatus::UseProxy, "305" },
-    { HttpStatus::TemporaryRedirect, "307" },
-    { HttpStatus::BadRequest, "400" },
-    { HttpStatus::Unauthorized, "401" },
-    { HttpStatus::PaymentRequired, "402" },
-    { HttpStatus::Forbidden, "403" },
-    { HttpStatus::NotFound, "404" },
-    { HttpStatus::MethodNotAllowed, "405" },
-    { HttpStatus::NotAcceptable, "406" },
-    { HttpStatus::ProxyAuthenticationRequired, "407" },
-    { HttpStatus::RequestTimeOut, "408" },
-    { HttpStatus::Conflict, "409" },
-    { HttpStatus::Gone, "410" },
-    { HttpStatus::LengthRequired, "411" },
-    { HttpStatus::PreconditionFailed, "412" },
-    { HttpStatus::RequestEntityTooLarge, "413" },
-    { HttpStatus::RequestURITooLarge, "414" },
-    { HttpStatus::UnsupportedMediaType, "415" },
-    { HttpStatus::RequestedRangeNotSatisfiable, "416" },
-    { HttpStatus::ExpectationFailed, "417" },
-    { HttpStatus::InternalServerError, "500" },
-    { HttpStatus::NotImplemented, "501" },
-    { HttpStatus::BadGateway, "502" },
-    { HttpStatus::ServiceUnavailable, "503" },
-    { HttpStatus::GatewayTimeOut, "504" },
-    { HttpStatus::HTTPVersionNotSupported, "505" },
+    { "0", "Not Set", "HTTP/1.1 0 Not Set\r\n" }, // NotSet
+    { "100", "Continue", "HTTP/1.1 100 Continue\r\n" }, // Continue
+    { "101", "Switching Protocols", "HTTP/1.1 101 Switching Protocols\r\n" }, // SwitchingProtocols
+    { "200", "OK", "HTTP/1.1 200 OK\r\n" }, // OK
+    { "201", "Created", "HTTP/1.1 201 Created\r\n" }, // Created
+    { "202", "Accepted", "HTTP/1.1 202 Accepted\r\n" }, // Accepted
+    { "203", "Non Authoritative Information", "HTTP/1.1 203 Non Authoritative Information\r\n" }, // NonAuthoritativeInformation
+    { "204", "No Content", "HTTP/1.1 204 No Content\r\n" }, // NoContent
+    { "205", "Reset Content", "HTTP/1.1 205 Reset Content\r\n" }, // ResetContent
+    { "206", "Partial Content", "HTTP/1.1 206 Partial Content\r\n" }, // PartialContent
+    { "300", "Multiple Choices", "HTTP/1.1 300 Multiple Choices\r\n" }, // MultipleChoices
+    { "301", "Moved Permanently", "HTTP/1.1 301 Moved Permanently\r\n" }, // MovedPermanently
+    { "302", "Found", "HTTP/1.1 302 Found\r\n" }, // Found
+    { "303", "See Other", "HTTP/1.1 303 See Other\r\n" }, // SeeOther
+    { "304", "Not Modified", "HTTP/1.1 304 Not Modified\r\n" }, // NotModified
+    { "305", "Use Proxy", "HTTP/1.1 305 Use Proxy\r\n" }, // UseProxy
+    { "307", "Temporary Redirect", "HTTP/1.1 307 Temporary Redirect\r\n" }, // TemporaryRedirect
+    { "400", "Bad Request", "HTTP/1.1 400 Bad Request\r\n" }, // BadRequest
+    { "401", "Unauthorized", "HTTP/1.1 401 Unauthorized\r\n" }, // Unauthorized
+    { "402", "Payment Required", "HTTP/1.1 402 Payment Required\r\n" }, // PaymentRequired
+    { "403", "Forbidden", "HTTP/1.1 403 Forbidden\r\n" }, // Forbidden
+    { "404", "Not Found", "HTTP/1.1 404 Not Found\r\n" }, // NotFound
+    { "405", "Method Not Allowed", "HTTP/1.1 405 Method Not Allowed\r\n" }, // MethodNotAllowed
+    { "406", "Not Acceptable", "HTTP/1.1 406 Not Acceptable\r\n" }, // NotAcceptable
+    { "407", "Proxy Authentication Required", "HTTP/1.1 407 Proxy Authentication Required\r\n" }, // ProxyAuthenticationRequired
+    { "408", "Request TimeOut", "HTTP/1.1 408 Request TimeOut\r\n" }, // RequestTimeOut
+    { "409", "Conflict", "HTTP/1.1 409 Conflict\r\n" }, // Conflict
+    { "410", "Gone", "HTTP/1.1 410 Gone\r\n" }, // Gone
+    { "411", "Length Required", "HTTP/1.1 411 Length Required\r\n" }, // LengthRequired
+    { "412", "Precondition Failed", "HTTP/1.1 412 Precondition Failed\r\n" }, // PreconditionFailed
+    { "413", "Request Entity Too Large", "HTTP/1.1 413 Request Entity Too Large\r\n" }, // RequestEntityTooLarge
+    { "414", "Request URI Too Large", "HTTP/1.1 414 Request URI Too Large\r\n" }, // RequestURITooLarge
+    { "415", "Unsupported Media Type", "HTTP/1.1 415 Unsupported Media Type\r\n" }, // UnsupportedMediaType
+    { "416", "Requested Range Not Satisfiable", "HTTP/1.1 416 Requested Range Not Satisfiable\r\n" }, // RequestedRangeNotSatisfiable
+    { "417", "Expectation Failed", "HTTP/1.1 417 Expectation Failed\r\n" }, // ExpectationFailed
+    { "431", "Request Header Fields Too Large", "HTTP/1.1 431 Request Header Fields Too Large\r\n" }, // RequestHeaderFieldsTooLarge
+    { "500", "Internal Server Error", "HTTP/1.1 500 Internal Server Error\r\n" }, // InternalServerError
+    { "501", "Not Implemented", "HTTP/1.1 501 Not Implemented\r\n" }, // NotImplemented
+    { "502", "Bad Gateway", "HTTP/1.1 502 Bad Gateway\r\n" }, // BadGateway
+    { "503", "Service Unavailable", "HTTP/1.1 503 Service Unavailable\r\n" }, // ServiceUnavailable
+    { "504", "Gateway Time Out", "HTTP/1.1 504 Gateway Time Out\r\n" }, // GatewayTimeOut
+    { "505", "HTTP Version Not Supported", "HTTP/1.1 505 HTTP Version Not Supported\r\n" }, // HTTPVersionNotSupported
 };
 
+static_assert(size(statuses) == (size_t)HttpStatus::HTTPVersionNotSupported + 1, "a status is missing from 'statuses'");
+
 const unordered_map<string, HttpStatus> statusNames =
 {
     { "0", HttpStatus::NotSet },
@@ -97,6 +103,7 @@ const unordered_map<string, HttpStatus> statusNames =
     { "415", HttpStatus::UnsupportedMediaType },
     { "416", HttpStatus::RequestedRangeNotSatisfiable },
     { "417", HttpStatus::ExpectationFailed },
+    { "431", HttpStatus::RequestHeaderFieldsTooLarge },
     { "500", HttpStatus::InternalServerError },
     { "501", HttpStatus::NotImplemented },
     { "502", HttpStatus::BadGateway },
@@ -105,64 +112,8 @@ const unordered_map<string, HttpStatus> statusNames =
     { "505", HttpStatus::HTTPVersionNotSupported },
 };
 
-const unordered_map<HttpStatus, string, EnumClassHash> statusReasons =
-{
-    { HttpStatus::NotSet, "Not Set"},
-    { HttpStatus::Continue, "Continue"},
-    { HttpStatus::SwitchingProtocols, "Switching Protocols"},
-    { HttpStatus::OK, "OK"},
-    { HttpStatus::Created, "Created"},
-    { HttpStatus::Accepted, "Accepted"},
-    { HttpStatus::NonAuthoritativeInformation, "Non Authoritative Information"},
-    { HttpStatus::NoContent, "No Content"},
-    { HttpStatus::ResetContent, "Reset Content"},
-    { HttpStatus::PartialContent, "Partial Content"},
-    { HttpStatus::MultipleChoices, "Multiple Choices"},
-    { HttpStatus::MovedPermanently, "Moved Permanently"},
-    { HttpStatus::Found, "Found"},
-    { HttpStatus::SeeOther, "See Other"},
-    { HttpStatus::NotModified, "Not Modified"},
-    { HttpStatus::UseProxy, "Use Proxy"},
-    { HttpStatus::TemporaryRedirect, "Temporary Redirect"},
-    { HttpStatus::BadRequest, "Bad Request"},
-    { HttpStatus::Unauthorized, "Unauthorized"},
-    { HttpStatus::PaymentRequired, "Payment Required"},
-    { HttpStatus::Forbidden, "Forbidden"},
-    { HttpStatus::NotFound, "Not Found"},
-    { HttpStatus::MethodNotAllowed, "Method Not Allowed"},
-    { HttpStatus::NotAcceptable, "Not Acceptable"},
-    { HttpStatus::ProxyAuthenticationRequired, "Proxy Authentication Required"},
-    { HttpStatus::RequestTimeOut, "Request TimeOut"},
-    { HttpStatus::Conflict, "Conflict"},
-    { HttpStatus::Gone, "Gone"},
-    { HttpStatus::LengthRequired, "Length Required"},
-    { HttpStatus::PreconditionFailed, "Precondition Failed"},
-    { HttpStatus::RequestEntityTooLarge, "Request Entity Too Large"},
-    { HttpStatus::RequestURITooLarge, "Request URI Too Large"},
-    { HttpStatus::UnsupportedMediaType, "Unsupported Media Type"},
-    { HttpStatus::RequestedRangeNotSatisfiable, "Requested Range Not Satisfiable"},
-    { HttpStatus::ExpectationFailed, "Expectation Failed"},
-    { HttpStatus::InternalServerError, "Internal Server Error"},
-    { HttpStatus::NotImplemented, "Not Implemented"},
-    { HttpStatus::BadGateway, "Bad Gateway"},
-    { HttpStatus::ServiceUnavailable, "Service Unavailable"},
-    { HttpStatus::GatewayTimeOut, "Gateway Time Out"},
-    { HttpStatus::HTTPVersionNotSupported, "HTTP Version Not Supported"}
-};
-
-const unordered_map<HttpMethod, string, EnumClassHash> methodNames =
-{
-    { HttpMethod::Connect, "CONNECT"},
-    { HttpMethod::Delete, "DELETE"},
-    { HttpMethod::Get, "GET"},
-    { HttpMethod::Head, "HEAD"},
-    { HttpMethod::Options, "OPTIONS"},
-    { HttpMethod::Post, "POST"},
-    { HttpMethod::Put, "PUT"},
-    { HttpMethod::Trace, "TRACE"},
-};
-
-const unordered_map<string, HttpMethod> methods =
+// in HttpMethod order
+const pair<string_view, HttpMethod> methods[] =
 {
     { "CONNECT", HttpMethod::Connect},
     { "DELETE", HttpMethod::Delete},
@@ -174,13 +125,106 @@ const unordered_map<string, HttpMethod> methods =
     { "TRACE", HttpMethod::Trace },
 };
 
+namespace
+{
+    // writes to a buffer that's already known to be large enough
+    struct HeaderWriter
+    {
+        char* p;
+
+        void Write(string_view text) {
+            memcpy(p, text.data(), text.size());
+            p += text.size();
+        }
+
+        template<class Fields>
+        void WriteFields(const Fields& fields)
+        {
+            for(auto& field : fields)
+            {
+                Write(field.name);
+                Write(": ");
+                Write(field.value);
+                Write("\r\n");
+            }
+
+            Write("\r\n");
+        }
+    };
+
+    template<class Fields>
+    size_t FieldsSize(const Fields& fields)
+    {
+        size_t size = 2; // the blank line
+
+        for(auto& field : fields)
+            size += field.name.size() + 2 + field.value.size() + 2;
+
+        return size;
+    }
+}
+
 namespace Http
 {
+    size_t FormatContentRange(char* buffer, uint64_t first, uint64_t last, uint64_t size)
+    {
+        char* p = buffer;
+        memcpy(p, "bytes ", 6);
+        p = to_chars(p + 6, p + 26, first).ptr;
+        *p++ = '-';
+        p = to_chars(p, p + 20, last).ptr;
+        *p++ = '/';
+        p = to_chars(p, p + 20, size).ptr;
+        return p - buffer;
+    }
+
+    void FormatDate(char* buffer, int64_t time)
+    {
+        static constexpr char dayNames[] = "SunMonTueWedThuFriSat";
+        static constexpr char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+        int64_t days = time / 86400;
+        int64_t seconds = time % 86400;
+
+        // the civil date of 'days', counting from 0000-03-01 so leap days come last
+        int64_t z = days + 719468;
+        int64_t era = z / 146097;
+        int64_t dayOfEra = z - era * 146097;
+        int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int64_t monthFromMarch = (5 * dayOfYear + 2) / 153;
+        int64_t day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+        int64_t month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+        int64_t year = yearOfEra + era * 400 + (month <= 2);
+
+        auto write2 = [](char* p, int64_t n) {
+            p[0] = (char)('0' + n / 10);
+            p[1] = (char)('0' + n % 10);
+        };
+
+        // 1970-01-01 was a Thursday
+        memcpy(buffer, dayNames + (days + 4) % 7 * 3, 3);
+        memcpy(buffer + 3, ", ", 2);
+        write2(buffer + 5, day);
+        buffer[7] = ' ';
+        memcpy(buffer + 8, monthNames + (month - 1) * 3, 3);
+        buffer[11] = ' ';
+        write2(buffer + 12, year / 100);
+        write2(buffer + 14, year % 100);
+        buffer[16] = ' ';
+        write2(buffer + 17, seconds / 3600);
+        buffer[19] = ':';
+        write2(buffer + 20, seconds / 60 % 60);
+        buffer[22] = ':';
+        write2(buffer + 23, seconds % 60);
+        memcpy(buffer + 25, " GMT", 4);
+    }
+
     char FromHex(char ch) {
         return isdigit(ch) ? ch - '0' : (::tolower(ch)) - 'a' + 10;
     }
 
-    string DecodeURL(const string& encoded)
+    string DecodeURL(string_view encoded)
     {
         string ret;
         ret.reserve(encoded.size() - count(encoded.begin(), encoded.end(), '%'));
@@ -207,27 +251,54 @@ namespace Http
         return ret;
     }
 
-    bool ParseRequestLine(const string& requestLine, HttpMethod& method, string& url, string& vers)
+    string_view TrimSpace(string_view str)
     {
-        regex reg("(CONNECT|DELETE|GET|HEAD|OPTIONS|POST|PUT|TRACE) (.+) HTTP/(.+)");
-        smatch match;
+        while(!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+            str.remove_prefix(1);
+
+        while(!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+            str.remove_suffix(1);
+
+        return str;
+    }
 
-        if(!regex_search(requestLine, match, reg) || match.size() != 4)
+    bool ParseRequestLine(string_view requestLine, HttpMethod& method, string_view& url, string_view& vers)
+    {
+        size_t methodEnd = requestLine.find(' ');
+        if(methodEnd == string_view::npos)
+            return false;
+
+        auto name = requestLine.substr(0, methodEnd);
+        auto it = find_if(begin(methods), end(methods), [name](auto& m) { return m.first == name; });
+        if(it == end(methods))
             return false;
 
-        auto it = methods.find(match[1]);
-        if(it == methods.end())
+        // the version follows the last " HTTP/", so the URL may contain spaces
+        size_t versionStart = requestLine.rfind(" HTTP/");
+        if(versionStart == string_view::npos || versionStart <= methodEnd)
             return false;
 
         method = it->second;
-        url = match[2];
-        vers = match[3];
+        url = requestLine.substr(methodEnd + 1, versionStart - methodEnd - 1);
+        vers = requestLine.substr(versionStart + 6);
+        return !url.empty() && !vers.empty();
+    }
+
+    bool ParseRequestLine(const string& requestLine, HttpMethod& method, string& url, string& vers)
+    {
+        string_view urlView, versView;
+
+        if(!ParseRequestLine(string_view(requestLine), method, urlView, versView))
+            return false;
+
+        url = urlView;
+        vers = versView;
         return true;
     }
 
     bool ParseStatusLine(const string& statusLine, string& version, HttpStatus& code, string& reason)
     {
-        regex reg("HTTP/([\\d\\.]+) (\\d{3}) (.+)");
+        static const regex reg("HTTP/([\\d\\.]+) (\\d{3}) (.+)");
         smatch match;
 
         if(!regex_search(statusLine, match, reg) || match.size() != 4)
@@ -243,29 +314,38 @@ namespace Http
         return true;
     }
 
+    bool ParseHeaderField(string_view line, string_view& name, string_view& value)
+    {
+        size_t colon = line.find(':');
+        if(colon == string_view::npos)
+            return false;
+
+        name = TrimSpace(line.substr(0, colon));
+        value = TrimSpace(line.substr(colon + 1));
+        return !name.empty() && !value.empty();
+    }
+
     pair<string, string> ParseHeaderField(const string& line)
     {
         pair<string, string> parts;
+        string_view name, value;
 
-        smatch match;
-        regex reg("\\s*(.+)\\s*:\\s*(.+)\\s*");
-
-        if(regex_search(line, match, reg)) {
-            parts.first = match[1];
-            parts.second = match[2];
+        if(ParseHeaderField(string_view(line), name, value)) {
+            parts.first = name;
+            parts.second = value;
         }
 
         return parts;
     }
 
-    vector<ContentRange> ParseRange(const string &field)
+    vector<ContentRange> ParseRange(string_view field)
     {
-        regex reg("bytes\\s*=\\s*(\\d*)\\s*-\\s*(\\d*)\\s*(?:\\s*,\\s*(\\d*)\\s*-\\s*(\\d*))*");
-        smatch match;
+        static const regex reg("bytes\\s*=\\s*(\\d*)\\s*-\\s*(\\d*)\\s*(?:\\s*,\\s*(\\d*)\\s*-\\s*(\\d*))*");
+        cmatch match;
 
         vector<ContentRange> ret;
 
-        if(regex_search(field, match, reg))
+        if(regex_search(field.data(), field.data() + field.size(), match, reg))
         {
             for(int i = 1; i < (int)match.size() - 1; i += 2)
             {
@@ -312,61 +392,227 @@ bool HttpRequest::Parse(const vector<char>& request) {
 
 bool HttpRequest::Parse(const char *pRequest, size_t length)
 {
-    auto end = strstr(pRequest, "\r\n\r\n");
-    if(end == nullptr)
+    HttpRequestView view;
+    if(!view.Parse(pRequest, length))
         return false;
 
-    size_t headerLength = end - pRequest;
-    string header(pRequest, headerLength);
+    method = view.method;
+    uri = view.uri;
+    version = view.version;
 
-    vector<string> lines = Split(header, "\r\n");
-    if(lines.empty())
-        return false;
+    for(auto& field : view.fields)
+        fields.Add(string(field.name), string(field.value));
 
-    if(!ParseRequestLine(lines[0], this->method, this->uri, this->version))
-        return false;
+    content.assign(pRequest + view.headerLength, pRequest + length);
+    return true;
+}
 
-    for(size_t i = 1; i < lines.size(); ++i)
+void HttpRequest::Serialize(vector<char>& buffer)
+{
+    auto methodName = methods[(int)method].first;
+
+    size_t headerSize = methodName.size() + 1 + uri.size() + 6 + version.size() + 2 + FieldsSize(fields);
+
+    buffer.clear();
+    buffer.reserve(headerSize + content.size());
+    buffer.resize(headerSize);
+
+    HeaderWriter writer{ buffer.data() };
+    writer.Write(methodName);
+    writer.Write(" ");
+    writer.Write(uri);
+    writer.Write(" HTTP/");
+    writer.Write(version);
+    writer.Write("\r\n");
+    writer.WriteFields(fields);
+
+    if(!content.empty())
+        buffer.insert(buffer.end(), content.begin(), content.end());
+}
+
+// HTTP REQUEST VIEW
+
+bool HttpRequestView::Parse(const char* pRequest, size_t length)
+{
+    Reset();
+
+    const char* line = pRequest;
+    const char* scanFrom = pRequest;
+    const char* end = pRequest + length;
+
+    while(true)
     {
-        auto parts = ParseHeaderField(lines[i]);
+        switch(ParseLine(line, scanFrom, end))
+        {
+        case LineResult::Line:
+            line = scanFrom;
+            break;
 
-        if(parts.first.empty() || parts.second.empty())
+        case LineResult::End:
+            headerLength = scanFrom - pRequest;
+            return true;
+
+        default:
             return false;
+        }
+    }
+}
+
+void HttpRequestView::Reset()
+{
+    method = HttpMethod::Get;
+    uri = string_view();
+    version = string_view();
+    fields.Clear();
+    headerLength = 0;
+}
 
-        fields.insert(move(parts));
+HttpRequestView::LineResult HttpRequestView::ParseLine(const char* line, const char*& scanFrom, const char* end)
+{
+    // the first control character has to be the CRLF that ends the line
+    const char* lineEnd = FindControl(scanFrom, end);
+    if(end - lineEnd < 2) {
+        scanFrom = lineEnd;
+        return LineResult::Incomplete;
     }
 
-    const char *contentStart = pRequest + headerLength + 4;
-    const char *contentEnd = contentStart + (length - headerLength - 4);
-    content.assign(contentStart, contentEnd);
+    if(lineEnd[0] != '\r' || lineEnd[1] != '\n')
+        return LineResult::Invalid;
 
-    return true;
+    scanFrom = lineEnd + 2;
+
+    // empty lines before the request line are ignored
+    if(lineEnd == line)
+        return version.empty() ? LineResult::Line : LineResult::End;
+
+    if(version.empty())
+    {
+        // the method is a token followed by a space
+        const char* methodEnd = FindNonToken(line, lineEnd);
+        if(methodEnd == lineEnd || *methodEnd != ' ')
+            return LineResult::Invalid;
+
+        if(!ParseRequestLine(string_view(line, lineEnd - line), method, uri, version))
+            return LineResult::Invalid;
+
+        return LineResult::Line;
+    }
+
+    // the name is a token followed directly by a colon
+    const char* nameEnd = FindNonToken(line, lineEnd);
+    if(nameEnd == line || nameEnd == lineEnd || *nameEnd != ':')
+        return LineResult::Invalid;
+
+    if(fields.size() == MaxFields)
+        return LineResult::Invalid;
+
+    auto value = TrimSpace(string_view(nameEnd + 1, lineEnd - nameEnd - 1));
+    if(value.empty())
+        return LineResult::Invalid;
+
+    fields.Add(string_view(line, nameEnd - line), value);
+    return LineResult::Line;
 }
 
-void HttpRequest::Serialize(vector<char>& buffer)
+void HttpRequestView::Rebase(const char* from, const char* to)
 {
-    stringstream request;
+    auto rebase = [from, to](string_view& view) {
+        if(!view.empty())
+            view = string_view(to + (view.data() - from), view.size());
+    };
 
-    request << std::noskipws;
-
-    request << methodNames.find(method)->second << " " << uri << " " << "HTTP/" << version << "\r\n";
+    rebase(uri);
+    rebase(version);
 
     for(auto& field : fields)
-        request << field.first << ": " << field.second << "\r\n";
+    {
+        rebase(field.name);
+        rebase(field.value);
+    }
+}
 
-    request << "\r\n";
+// HTTP REQUEST PARSER
 
-    size_t sz = (size_t)request.tellp();
+HttpRequestParser::HttpRequestParser(size_t maxHeaderSize)
+    : maxSize(maxHeaderSize)
+{
+}
 
-    buffer.clear();
-    buffer.reserve(sz + content.size());
-    buffer.resize(sz);
+char* HttpRequestParser::Prepare(size_t& space)
+{
+    if(size == buffer.size())
+    {
+        // the parsed lines point into the buffer, so they're moved along with it
+        if(start != 0)
+        {
+            memmove(buffer.data(), buffer.data() + start, size - start);
+            req.Rebase(buffer.data() + start, buffer.data());
 
-    request.seekg(0, ios::beg);
-    request.read(buffer.data(), sz);
+            size -= start;
+            lineStart -= start;
+            scanned -= start;
+            start = 0;
+        }
+        else if(size < maxSize)
+        {
+            vector<char> larger(min(max(buffer.size() * 2, InitialBufferSize), maxSize));
+            memcpy(larger.data(), buffer.data(), size);
+            req.Rebase(buffer.data(), larger.data());
+            buffer.swap(larger);
+        }
+    }
 
-    if(!content.empty())
-        buffer.insert(buffer.end(), content.begin(), content.end());
+    space = buffer.size() - size;
+    return buffer.data() + size;
+}
+
+HttpRequestParser::Result HttpRequestParser::Commit(size_t count)
+{
+    size += count;
+    return Parse();
+}
+
+HttpRequestParser::Result HttpRequestParser::Next()
+{
+    // the next request starts right after this one's header
+    start += req.headerLength;
+    if(start == size)
+        start = size = 0;
+
+    req.Reset();
+    lineStart = start;
+    scanned = start;
+
+    return size != start ? Parse() : Result::Incomplete;
+}
+
+HttpRequestParser::Result HttpRequestParser::Parse()
+{
+    const char* base = buffer.data();
+    const char* end = base + size;
+    const char* scanFrom = base + scanned;
+
+    while(true)
+    {
+        auto line = req.ParseLine(base + lineStart, scanFrom, end);
+
+        if(line == HttpRequestView::LineResult::Incomplete)
+        {
+            scanned = scanFrom - base;
+            return size - start < maxSize ? Result::Incomplete : Result::TooLarge;
+        }
+
+        if(line == HttpRequestView::LineResult::Invalid)
+            return Result::Invalid;
+
+        lineStart = scanned = scanFrom - base;
+
+        if(line == HttpRequestView::LineResult::End)
+        {
+            req.headerLength = lineStart - start;
+            return Result::Complete;
+        }
+    }
 }
 
 // HTTP RESPONSE
@@ -438,7 +684,7 @@ bool HttpResponse::Parse(const char *pResponse, size_t length)
         if(parts.first.empty() || parts.second.empty())
             return false;
 
-        fields.insert(move(parts));
+        fields.Add(move(parts.first), move(parts.second));
     }
 
     const char *contentStart = pResponse + headerLength + 4;
@@ -450,39 +696,75 @@ bool HttpResponse::Parse(const char *pResponse, size_t length)
 
 void HttpResponse::Serialize(vector<char>& buffer)
 {
-    stringstream response;
-    response << std::noskipws;
-    response << "HTTP/" << version << " " << statusCodes.at(status) << " " << statusReasons.at(status) << "\r\n";
+    SerializeHeader(buffer);
 
-    for(auto& field : fields)
-        response << field.first << ": " << field.second << "\r\n";
+    if(!content.empty())
+        buffer.insert(buffer.end(), content.begin(), content.end());
+}
 
-    response << "\r\n";
+void HttpResponse::SerializeHeader(vector<char>& buffer, string_view commonFields)
+{
+    size_t headerSize = HeaderSize(commonFields);
 
-    size_t headerSize = (size_t)response.tellp();
     buffer.clear();
     buffer.reserve(headerSize + content.size());
     buffer.resize(headerSize);
 
-    response.seekg(0, ios::beg);
-    response.read(buffer.data(), headerSize);
+    SerializeHeader(buffer.data(), headerSize, commonFields);
+}
 
-    if(!content.empty())
-        buffer.insert(buffer.end(), content.begin(), content.end());
+size_t HttpResponse::HeaderSize(string_view commonFields) const
+{
+    auto& info = statuses[(int)status];
+
+    size_t lineSize = version == "1.1" ? info.line.size()
+        : 5 + version.size() + 1 + info.code.size() + 1 + info.reason.size() + 2;
+
+    return lineSize + commonFields.size() + FieldsSize(fields);
+}
+
+size_t HttpResponse::SerializeHeader(char* buffer, size_t size, string_view commonFields) const
+{
+    size_t headerSize = HeaderSize(commonFields);
+    if(headerSize > size)
+        return headerSize;
+
+    auto& info = statuses[(int)status];
+    HeaderWriter writer{ buffer };
+
+    if(version == "1.1")
+    {
+        writer.Write(info.line);
+    }
+    else
+    {
+        writer.Write("HTTP/");
+        writer.Write(version);
+        writer.Write(" ");
+        writer.Write(info.code);
+        writer.Write(" ");
+        writer.Write(info.reason);
+        writer.Write("\r\n");
+    }
+
+    if(!commonFields.empty())
+        writer.Write(commonFields);
+
+    writer.WriteFields(fields);
+    return headerSize;
 }
 
 HttpResponse HttpResponse::Create(HttpStatus status, bool keepAlive)
 {
-    string code = statusCodes.at(status);
-    string reason = statusReasons.at(status);
-    string page = format("<html><h1 style=\"text-align: center\">%: %</h1></html>", code, reason);
+    auto& info = statuses[(int)status];
+    string page = format("<html><h1 style=\"text-align: center\">%: %</h1></html>", info.code, info.reason);
 
     HttpResponse resp;
     resp.status = status;
-    resp.fields["Connection"] = keepAlive ? "keep-alive" : "close";
-    resp.fields["Content-Encoding"] = "identity";
-    resp.fields["Content-Type"] = "text/html; charset=utf-8";
-    resp.fields["Content-Length"] = to_string(page.size());
+    resp.fields.Set(HttpField::Connection, keepAlive ? "keep-alive" : "close");
+    resp.fields.Set(HttpField::ContentEncoding, "identity");
+    resp.fields.Set(HttpField::ContentType, "text/html; charset=utf-8");
+    resp.fields.Set(HttpField::ContentLength, (uint64_t)page.size());
     resp.content.assign(page.begin(), page.end());
     return resp;
 }
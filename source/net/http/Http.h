@@ -13,7 +13,9 @@
 #include <limits>
 #include <unordered_map>
 #include <optional>
+#include <string_view>
 #include <system/format.h>
+#include <net/http/HttpFields.h>
 
 enum class HttpMethod
 {
@@ -64,6 +66,7 @@ enum class HttpStatus
     UnsupportedMediaType,
     RequestedRangeNotSatisfiable,
     ExpectationFailed,
+    RequestHeaderFieldsTooLarge,
     InternalServerError,
     NotImplemented,
     BadGateway,
@@ -76,12 +79,24 @@ namespace Http
 {
     typedef std::pair<std::optional<size_t>, std::optional<size_t>> ContentRange;
 
-    std::vector<ContentRange> ParseRange(const std::string &field);
-    std::string DecodeURL(const std::string& encoded);
+    std::vector<ContentRange> ParseRange(std::string_view field);
+    std::string DecodeURL(std::string_view encoded);
+    bool ParseRequestLine(std::string_view requestLine, HttpMethod& method, std::string_view& url, std::string_view& vers);
     bool ParseRequestLine(const std::string& requestLine, HttpMethod& method, std::string& url, std::string& vers);
     bool ParseStatusLine(const std::string& statusLine, std::string& version, HttpStatus& code, std::string& reason);
+    bool ParseHeaderField(std::string_view line, std::string_view& name, std::string_view& value);
     std::pair<std::string, std::string> ParseHeaderField(const std::string& line);
     std::vector<std::string> Split(const std::string &str, const std::string &delimeters);
+
+    // writes a Content-Range value, "bytes first-last/size", to 'buffer', which needs
+    // room for MaxContentRangeSize characters. Returns the number written.
+    constexpr size_t MaxContentRangeSize = 6 + 20 + 1 + 20 + 1 + 20;
+    size_t FormatContentRange(char* buffer, uint64_t first, uint64_t last, uint64_t size);
+
+    // writes 'time', in seconds since 1970 and before the year 10000, as an HTTP date,
+    // e.g. "Sun, 06 Nov 1994 08:49:37 GMT", which is always DateSize characters
+    constexpr size_t DateSize = 29;
+    void FormatDate(char* buffer, int64_t time);
 }
 
 class HttpRequest
@@ -90,7 +105,7 @@ public:
     HttpMethod method = HttpMethod::Get;
     std::string uri = "/";
     std::string version = "1.1";
-    std::unordered_map<std::string, std::string> fields;
+    HttpFields fields;
     std::vector<char> content;
 
     bool Parse(const std::vector<char>& request);
@@ -98,13 +113,116 @@ public:
     void Serialize(std::vector<char>& buffer);
 };
 
+// A request header parsed in place, without allocating. The views point into
+// the buffer passed to Parse(), and are only valid for as long as it is.
+class HttpRequestView
+{
+public:
+    static constexpr size_t MaxFields = 64;
+
+    HttpMethod method = HttpMethod::Get;
+    std::string_view uri;
+    std::string_view version;
+    HttpFieldViews fields;
+    size_t headerLength = 0; // up to and including the blank line that ends the header
+
+    // returns false if the header is incomplete, malformed, or has more than MaxFields fields.
+    // Field names must be tokens followed directly by ':', and lines can't contain control characters.
+    bool Parse(const char* pRequest, size_t length);
+
+    // returns an empty view if there's no field called 'name'. Names are case-insensitive.
+    std::string_view Find(std::string_view name) const { return fields.Find(name); }
+    std::string_view Find(HttpField field) const { return fields.Find(field); }
+
+private:
+    friend class HttpRequestParser;
+
+    enum class LineResult
+    {
+        Line,       // a line was parsed, or skipped
+        End,        // the blank line that ends the header
+        Incomplete, // the line hasn't been fully received
+        Invalid
+    };
+
+    void Reset();
+
+    // parses the line starting at 'line', looking for its end from 'scanFrom', which is left
+    // at the start of the next line. If the line is incomplete, it's left where the search stopped.
+    LineResult ParseLine(const char* line, const char*& scanFrom, const char* end);
+
+    // points the views into a copy of the buffer they were parsed from
+    void Rebase(const char* from, const char* to);
+};
+
+///<summary>
+///Receives a request header in pieces, parsing each line once it's complete, so bytes
+///are only scanned once no matter how the header is split up. Bytes received after
+///the header are kept, and become the start of the next request, so pipelined
+///requests are parsed from the buffer without being moved.
+///</summary>
+class HttpRequestParser
+{
+public:
+    static constexpr size_t DefaultMaxHeaderSize = 8192;
+
+    enum class Result
+    {
+        Incomplete, // more bytes are needed
+        Complete,   // request() is ready
+        Invalid,    // the header is malformed
+        TooLarge    // the header is longer than the limit
+    };
+
+    HttpRequestParser(size_t maxHeaderSize = DefaultMaxHeaderSize);
+
+    HttpRequestParser(const HttpRequestParser&) = delete;
+    HttpRequestParser& operator=(const HttpRequestParser&) = delete;
+
+    // returns where the next read should go, and sets 'space' to the number of bytes that
+    // fit there. The buffer starts small, and grows as needed up to the header size limit.
+    char* Prepare(size_t& space);
+
+    // parses 'count' bytes that were read into the space returned by Prepare()
+    Result Commit(size_t count);
+
+    // discards the current request, and parses any bytes that were received after it
+    Result Next();
+
+    const HttpRequestView& request() const { return req; }
+
+    // the length of the current request's header, once it's complete
+    size_t consumed() const { return req.headerLength; }
+
+    // the number of bytes received, including those of the current request
+    size_t buffered() const { return size - start; }
+
+    // true if bytes of another request were received after the current one's header
+    bool pipelined() const { return buffered() > consumed(); }
+
+    size_t maxHeaderSize() const { return maxSize; }
+
+private:
+    static constexpr size_t InitialBufferSize = 2048;
+
+    std::vector<char> buffer;
+    size_t start = 0;       // start of the current request. Earlier bytes have been consumed.
+    size_t size = 0;        // bytes received
+    size_t lineStart = 0;   // start of the line being parsed
+    size_t scanned = 0;     // how far that line has been searched for its end
+    size_t maxSize;
+    HttpRequestView req;    // points into 'buffer'
+
+    Result Parse();
+};
+
 class HttpResponse
 {
 public:
     std::string version = "1.1";
     HttpStatus status = HttpStatus::NotSet;
     std::string reason = "Not Set";
-    std::unordered_map<std::string, std::string> fields;
+    HttpFields fields;
     std::vector<char> content;
 
     HttpResponse();
@@ -118,5 +236,16 @@ public:
     bool Parse(const char *pResponse, size_t length);
     void Serialize(std::vector<char>& buffer);
 
+    // serializes everything but 'content', so it can be sent from where it is.
+    // 'commonFields' are complete field lines, written as they are after the status line.
+    void SerializeHeader(std::vector<char>& buffer, std::string_view commonFields = {});
+
+    // the size of the header that SerializeHeader() writes
+    size_t HeaderSize(std::string_view commonFields = {}) const;
+
+    // writes the header to 'buffer' if it fits in 'size' bytes. Returns the size of the
+    // header, so nothing was written if that's larger than 'size'.
+    size_t SerializeHeader(char* buffer, size_t size, std::string_view commonFields = {}) const;
+
     static HttpResponse Create(HttpStatus status, bool keepAlive = true);
 };
@@ -0,0 +1,117 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/http/HttpCannedResponses.h>
+#include <net/http/MimeTypes.h>
+#include <system/Console.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+bool HttpCannedResponses::IsError(HttpStatus status) {
+    return status >= HttpStatus::BadRequest && status <= HttpStatus::HTTPVersionNotSupported;
+}
+
+bool HttpCannedResponses::IsRedirect(HttpStatus status)
+{
+    return status == HttpStatus::MovedPermanently
+        || status == HttpStatus::Found
+        || status == HttpStatus::SeeOther
+        || status == HttpStatus::TemporaryRedirect;
+}
+
+void HttpCannedResponses::Build(const string& docsPath, const map<HttpStatus, string>& pages)
+{
+    for(size_t i = 0; i < StatusCount; ++i)
+    {
+        HttpStatus status = (HttpStatus)i;
+
+        if(IsError(status))
+        {
+            vector<char> page;
+            string type;
+
+            auto it = pages.find(status);
+            if(it != pages.end())
+            {
+                string path = docsPath + it->second;
+#ifdef _WIN32
+                for(char& ch : path)
+                {
+                    if(ch == '/')
+                        ch = '\\';
+                }
+#endif
+                ifstream fin(path, ios::in | ios::binary);
+                if(fin.is_open()) {
+                    page.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+                    type = MimeTypes::TypeForPath(path);
+                }
+                else {
+                    Console::WriteLine("can't read error page, using the default - %", path);
+                }
+            }
+
+            for(int keepAlive = 0; keepAlive < 2; ++keepAlive)
+            {
+                auto resp = HttpResponse::Create(status, keepAlive != 0);
+
+                if(!type.empty()) {
+                    resp.fields.Set(HttpField::ContentType, type);
+                    resp.fields.Set(HttpField::ContentLength, (uint64_t)page.size());
+                    resp.content = page;
+                }
+
+                resp.Serialize(responses[i][keepAlive]);
+            }
+        }
+        else if(IsRedirect(status))
+        {
+            for(int keepAlive = 0; keepAlive < 2; ++keepAlive)
+            {
+                HttpResponse resp;
+                resp.status = status;
+                resp.fields.Set(HttpField::Connection, keepAlive ? "keep-alive" : "close");
+                resp.fields.Set(HttpField::ContentLength, "0");
+
+                // the blank line that ends the header is overwritten by the start of the Location field
+                string_view location = "Location: ";
+                size_t headerSize = resp.HeaderSize();
+
+                auto& response = responses[i][keepAlive];
+                response.resize(headerSize + location.size() - 2);
+                resp.SerializeHeader(response.data(), response.size());
+                memcpy(response.data() + headerSize - 2, location.data(), location.size());
+            }
+        }
+        else
+        {
+            responses[i][0].clear();
+            responses[i][1].clear();
+        }
+    }
+}
+
+HttpCannedResponses::Response HttpCannedResponses::Error(HttpStatus status, bool keepAlive) const {
+    return IsError(status) ? Get(status, keepAlive) : Response();
+}
+
+HttpCannedResponses::Response HttpCannedResponses::Redirect(HttpStatus status, bool keepAlive) const {
+    return IsRedirect(status) ? Get(status, keepAlive) : Response();
+}
+
+HttpCannedResponses::Response HttpCannedResponses::Get(HttpStatus status, bool keepAlive) const
+{
+    auto& response = responses[(size_t)status][keepAlive];
+    string_view bytes(response.data(), response.size());
+
+    size_t lineSize = bytes.find("\r\n");
+    if(lineSize == string_view::npos)
+        return Response();
+
+    return Response{ bytes.substr(0, lineSize + 2), bytes.substr(lineSize + 2) };
+}
@@ -0,0 +1,57 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <net/http/Http.h>
+
+///<summary>
+///Error and redirect responses, serialized once so they can be sent as they are,
+///without building a response for each request. There's one for each status and
+///Connection value. Each is split after its status line, so the fields common to all
+///responses can be sent in between. Error responses are complete. Redirects end where
+///the value of their Location field starts, and are sent followed by the location and
+///RedirectEnd.
+///</summary>
+class HttpCannedResponses
+{
+public:
+    static constexpr std::string_view RedirectEnd = "\r\n\r\n";
+
+    struct Response
+    {
+        std::string_view statusLine;
+        std::string_view rest;
+    };
+
+    // true for 4xx and 5xx statuses
+    static bool IsError(HttpStatus status);
+
+    // true for 301, 302, 303 and 307
+    static bool IsRedirect(HttpStatus status);
+
+    ///<summary>
+    ///builds the responses. 'pages' maps error statuses to the files sent as their
+    ///bodies, relative to 'docsPath'. Statuses that aren't in 'pages', or whose page
+    ///can't be read, get a generated page.
+    ///</summary>
+    void Build(const std::string& docsPath, const std::map<HttpStatus, std::string>& pages);
+
+    // the complete response, or empty views if 'status' isn't an error or Build() hasn't been called
+    Response Error(HttpStatus status, bool keepAlive) const;
+
+    // the response up to the location, or empty views if 'status' isn't a redirect or Build() hasn't been called
+    Response Redirect(HttpStatus status, bool keepAlive) const;
+
+private:
+    static constexpr size_t StatusCount = (size_t)HttpStatus::HTTPVersionNotSupported + 1;
+
+    std::vector<char> responses[StatusCount][2]; // indexed by status and keepAlive
+
+    Response Get(HttpStatus status, bool keepAlive) const;
+};
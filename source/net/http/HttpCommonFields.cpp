@@ -0,0 +1,37 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/http/HttpCommonFields.h>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+using namespace chrono;
+
+HttpCommonFields::HttpCommonFields()
+{
+    // everything but the date is written once
+    char* p = buffer;
+    memcpy(p, DateStart.data(), DateStart.size());
+    p += DateStart.size() + Http::DateSize;
+    memcpy(p, ServerStart.data(), ServerStart.size());
+    p += ServerStart.size();
+    memcpy(p, ServerName.data(), ServerName.size());
+    p += ServerName.size();
+    memcpy(p, "\r\n", 2);
+
+    Refresh();
+}
+
+void HttpCommonFields::Refresh()
+{
+    int64_t now = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+
+    if(now != time)
+    {
+        Http::FormatDate(buffer + DateStart.size(), now);
+        time = now;
+    }
+}
@@ -0,0 +1,36 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <string_view>
+#include <cstdint>
+#include <net/http/Http.h>
+
+///<summary>
+///The fields sent with every response, "Date: ...\r\nServer: ...\r\n", kept in one block
+///that's copied into each header as it is. Only the date changes, and it's only
+///formatted by Refresh(), which the server calls once a second, instead of per response.
+///</summary>
+class HttpCommonFields
+{
+public:
+    static constexpr std::string_view ServerName = "web-server";
+
+    // formats the current time
+    HttpCommonFields();
+
+    // formats the current time, if the second has changed since the last call
+    void Refresh();
+
+    std::string_view block() const { return std::string_view(buffer, Size); }
+
+private:
+    static constexpr std::string_view DateStart = "Date: ";
+    static constexpr std::string_view ServerStart = "\r\nServer: ";
+    static constexpr size_t Size = DateStart.size() + Http::DateSize + ServerStart.size() + ServerName.size() + 2;
+
+    char buffer[Size];
+    int64_t time = -1;
+};
@@ -0,0 +1,193 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/http/HttpFields.h>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    constexpr string_view fieldNames[(size_t)HttpField::Count] = {
+        "Accept",
+        "Accept-Encoding",
+        "Accept-Language",
+        "Accept-Ranges",
+        "Authorization",
+        "Cache-Control",
+        "Connection",
+        "Content-Encoding",
+        "Content-Length",
+        "Content-Range",
+        "Content-Type",
+        "Cookie",
+        "Date",
+        "ETag",
+        "Expect",
+        "Host",
+        "If-Match",
+        "If-Modified-Since",
+        "If-None-Match",
+        "If-Range",
+        "If-Unmodified-Since",
+        "Last-Modified",
+        "Location",
+        "Origin",
+        "Range",
+        "Referer",
+        "Server",
+        "Transfer-Encoding",
+        "Upgrade",
+        "User-Agent",
+    };
+
+    // Hashes the length and the first and last characters, which is enough to tell
+    // the known names apart. The multipliers were found by trying them in order.
+    constexpr size_t HashSize = 64;
+
+    // the case bit is set on both characters, which lower-cases them if they're letters
+    constexpr size_t Hash(string_view name) {
+        return (name.size() * 2 + ((unsigned char)name.front() | 0x20) * 8 + ((unsigned char)name.back() | 0x20) * 7) % HashSize;
+    }
+
+    constexpr size_t MaxKnownLength = 24;
+
+    struct FieldTable
+    {
+        HttpField entries[HashSize] = {};
+        bool perfect = true;
+
+        // each name in lower case, and with 0x20 where it has a letter. A name matches
+        // if it equals 'lower' once it's OR'ed with 'caseBits', which lets it be
+        // compared several bytes at a time.
+        char lower[(size_t)HttpField::Count][MaxKnownLength] = {};
+        char caseBits[(size_t)HttpField::Count][MaxKnownLength] = {};
+
+        constexpr FieldTable()
+        {
+            for(size_t i = 0; i < HashSize; ++i)
+                entries[i] = HttpField::Other;
+
+            for(size_t i = 0; i < (size_t)HttpField::Count; ++i)
+            {
+                size_t h = Hash(fieldNames[i]);
+                if(entries[h] != HttpField::Other)
+                    perfect = false;
+
+                entries[h] = (HttpField)i;
+
+                for(size_t j = 0; j < fieldNames[i].size(); ++j)
+                {
+                    char c = fieldNames[i][j];
+                    bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                    lower[i][j] = letter ? (char)(c | 0x20) : c;
+                    caseBits[i][j] = letter ? 0x20 : 0;
+                }
+
+                // names shorter than 4 bytes can't be compared with Matches()
+                if(fieldNames[i].size() < 4 || fieldNames[i].size() > MaxKnownLength)
+                    perfect = false;
+            }
+        }
+    };
+
+    constexpr FieldTable fieldTable;
+    static_assert(fieldTable.perfect, "known field names need different hashes, and 4 to 24 characters");
+
+    template<class Word>
+    Word Load(const char* p)
+    {
+        Word word;
+        memcpy(&word, p, sizeof(Word));
+        return word;
+    }
+
+    template<class Word>
+    bool WordMatches(const char* name, size_t offset, HttpField field)
+    {
+        return (Load<Word>(name + offset) | Load<Word>(fieldTable.caseBits[(size_t)field] + offset))
+            == Load<Word>(fieldTable.lower[(size_t)field] + offset);
+    }
+
+    // 'name' has the same length as the known field's name. The last word overlaps the
+    // one before it, so no byte past the end of 'name' is read.
+    bool Matches(string_view name, HttpField field)
+    {
+        const char* p = name.data();
+        size_t length = name.size();
+
+        if(length < 8)
+            return WordMatches<uint32_t>(p, 0, field) && WordMatches<uint32_t>(p, length - 4, field);
+
+        for(size_t i = 0; i + 8 < length; i += 8)
+        {
+            if(!WordMatches<uint64_t>(p, i, field))
+                return false;
+        }
+
+        return WordMatches<uint64_t>(p, length - 8, field);
+    }
+}
+
+namespace Http
+{
+    bool EqualsIgnoreCase(string_view a, string_view b)
+    {
+        if(a.size() != b.size())
+            return false;
+
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            // letters differ only in bit 5 between cases
+            unsigned char x = (unsigned char)a[i];
+            unsigned char y = (unsigned char)b[i];
+
+            if(x != y && ((x | 0x20) != (y | 0x20) || (unsigned char)((x | 0x20) - 'a') > 'z' - 'a'))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool ContainsToken(string_view value, string_view token)
+    {
+        while(!value.empty())
+        {
+            size_t end = value.find(',');
+            string_view item = value.substr(0, end);
+
+            size_t first = item.find_first_not_of(" \t");
+            if(first != string_view::npos)
+            {
+                size_t last = item.find_last_not_of(" \t");
+                if(EqualsIgnoreCase(item.substr(first, last - first + 1), token))
+                    return true;
+            }
+
+            if(end == string_view::npos)
+                break;
+
+            value.remove_prefix(end + 1);
+        }
+
+        return false;
+    }
+
+    HttpField LookupField(string_view name)
+    {
+        if(name.empty())
+            return HttpField::Other;
+
+        HttpField field = fieldTable.entries[Hash(name)];
+        if(field == HttpField::Other || fieldNames[(size_t)field].size() != name.size() || !Matches(name, field))
+            return HttpField::Other;
+
+        return field;
+    }
+
+    string_view FieldName(HttpField field) {
+        return fieldNames[(size_t)field];
+    }
+}
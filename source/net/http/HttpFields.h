@@ -0,0 +1,264 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <charconv>
+#include <type_traits>
+#include <cstdint>
+
+// header fields that are looked up by the server, or commonly sent. Each one
+// has a slot in HttpFieldList, so finding it doesn't search the fields.
+enum class HttpField : uint8_t
+{
+    Accept,
+    AcceptEncoding,
+    AcceptLanguage,
+    AcceptRanges,
+    Authorization,
+    CacheControl,
+    Connection,
+    ContentEncoding,
+    ContentLength,
+    ContentRange,
+    ContentType,
+    Cookie,
+    Date,
+    ETag,
+    Expect,
+    Host,
+    IfMatch,
+    IfModifiedSince,
+    IfNoneMatch,
+    IfRange,
+    IfUnmodifiedSince,
+    LastModified,
+    Location,
+    Origin,
+    Range,
+    Referer,
+    Server,
+    TransferEncoding,
+    Upgrade,
+    UserAgent,
+
+    Count,
+    Other = Count // any other name
+};
+
+namespace Http
+{
+    // ASCII only, which is all field names can contain
+    bool EqualsIgnoreCase(std::string_view a, std::string_view b);
+
+    // true if the comma separated list 'value', e.g. of a Connection field, contains 'token', ignoring case
+    bool ContainsToken(std::string_view value, std::string_view token);
+
+    // case-insensitive. Returns HttpField::Other if 'name' isn't one of the known fields.
+    HttpField LookupField(std::string_view name);
+
+    // the usual spelling, e.g. "Content-Length"
+    std::string_view FieldName(HttpField field);
+}
+
+///<summary>
+///The fields of a message header, in the order they were added, with case-insensitive
+///lookup. Up to InlineCount fields are stored in the object itself, and the known fields
+///(see HttpField) are found through a slot each. 'String' is std::string for fields
+///that are owned, or std::string_view for fields that point into a buffer.
+///</summary>
+template<class String, size_t InlineCount>
+class HttpFieldList
+{
+public:
+    struct Field
+    {
+        String name;
+        String value;
+    };
+
+    HttpFieldList() = default;
+
+    HttpFieldList(const HttpFieldList& other) { *this = other; }
+    HttpFieldList(HttpFieldList&& other) noexcept { *this = std::move(other); }
+
+    HttpFieldList& operator=(const HttpFieldList& other)
+    {
+        if(this != &other)
+        {
+            if(other.heap.empty()) {
+                heap.clear();
+                std::copy(other.inlineFields, other.inlineFields + other.count, inlineFields);
+            }
+            else {
+                heap = other.heap;
+            }
+
+            count = other.count;
+            std::copy(std::begin(other.slots), std::end(other.slots), std::begin(slots));
+        }
+
+        return *this;
+    }
+
+    HttpFieldList& operator=(HttpFieldList&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(other.heap.empty()) {
+                heap.clear();
+                std::move(other.inlineFields, other.inlineFields + other.count, inlineFields);
+            }
+            else {
+                heap = std::move(other.heap);
+            }
+
+            count = other.count;
+            std::copy(std::begin(other.slots), std::end(other.slots), std::begin(slots));
+            other.Clear();
+        }
+
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Field* begin() { return data(); }
+    Field* end() { return data() + count; }
+    const Field* begin() const { return data(); }
+    const Field* end() const { return data() + count; }
+
+    Field& operator[](size_t index) { return data()[index]; }
+    const Field& operator[](size_t index) const { return data()[index]; }
+
+    // adds a field, even if there's already one with the same name
+    void Add(String name, String value)
+    {
+        HttpField known = Http::LookupField(name);
+        Append(Field{ std::move(name), std::move(value) }, known);
+    }
+
+    // replaces the value of the first field called 'name', or adds one
+    void Set(std::string_view name, String value)
+    {
+        size_t index = IndexOf(name);
+        if(index != count)
+            data()[index].value = std::move(value);
+        else
+            Add(String(name), std::move(value));
+    }
+
+    void Set(HttpField field, String value)
+    {
+        uint16_t slot = slots[(size_t)field];
+        if(slot != 0)
+            data()[slot - 1].value = std::move(value);
+        else
+            Append(Field{ String(Http::FieldName(field)), std::move(value) }, field);
+    }
+
+    // sets the value to 'number', in decimal, without going through a temporary string.
+    // Only for fields that own their values.
+    void Set(HttpField field, uint64_t number)
+    {
+        static_assert(!std::is_same_v<String, std::string_view>, "the value would point to a temporary");
+
+        char digits[20];
+        char* end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+
+        uint16_t slot = slots[(size_t)field];
+        if(slot != 0)
+            data()[slot - 1].value.assign(digits, end - digits);
+        else
+            Append(Field{ String(Http::FieldName(field)), String(digits, end - digits) }, field);
+    }
+
+    // returns the value of the first field called 'name', or an empty view if there isn't one
+    std::string_view Find(std::string_view name) const
+    {
+        size_t index = IndexOf(name);
+        return index != count ? std::string_view(data()[index].value) : std::string_view();
+    }
+
+    std::string_view Find(HttpField field) const
+    {
+        uint16_t slot = slots[(size_t)field];
+        return slot != 0 ? std::string_view(data()[slot - 1].value) : std::string_view();
+    }
+
+    bool Contains(HttpField field) const {
+        return slots[(size_t)field] != 0;
+    }
+
+    void Clear()
+    {
+        count = 0;
+        heap.clear();
+        std::fill(std::begin(slots), std::end(slots), (uint16_t)0);
+    }
+
+private:
+    Field inlineFields[InlineCount];
+    std::vector<Field> heap; // all of the fields, once there are more than InlineCount
+    size_t count = 0;
+    uint16_t slots[(size_t)HttpField::Count] = {}; // index + 1 of the first field of each kind, or zero
+
+    Field* data() { return heap.empty() ? inlineFields : heap.data(); }
+    const Field* data() const { return heap.empty() ? inlineFields : heap.data(); }
+
+    // returns 'count' if there's no field called 'name'
+    size_t IndexOf(std::string_view name) const
+    {
+        HttpField known = Http::LookupField(name);
+        if(known != HttpField::Other)
+        {
+            uint16_t slot = slots[(size_t)known];
+            return slot != 0 ? slot - 1 : count;
+        }
+
+        const Field* fields = data();
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            if(Http::EqualsIgnoreCase(fields[i].name, name))
+                return i;
+        }
+
+        return count;
+    }
+
+    void Append(Field field, HttpField known)
+    {
+        if(known != HttpField::Other && slots[(size_t)known] == 0 && count < UINT16_MAX)
+            slots[(size_t)known] = (uint16_t)(count + 1);
+
+        if(count < InlineCount) {
+            inlineFields[count++] = std::move(field);
+            return;
+        }
+
+        // moves everything out of 'inlineFields' the first time they're full
+        if(heap.empty())
+        {
+            heap.reserve(InlineCount * 2);
+            for(size_t i = 0; i < count; ++i)
+                heap.push_back(std::move(inlineFields[i]));
+        }
+
+        heap.push_back(std::move(field));
+        ++count;
+    }
+};
+
+// fields that own their names and values
+using HttpFields = HttpFieldList<std::string, 12>;
+
+// fields that point into a parsed buffer
+using HttpFieldViews = HttpFieldList<std::string_view, 24>;
@@ -0,0 +1,120 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/http/HttpFileCache.h>
+#include <net/http/MimeTypes.h>
+#include <functional>
+#include <mutex>
+
+using namespace std;
+using namespace chrono;
+
+void HttpFileCache::Configure(size_t maxEntries, milliseconds ttl)
+{
+    Clear();
+    this->maxEntries = maxEntries;
+    this->ttl = ttl;
+}
+
+shared_ptr<const HttpFileCache::Entry> HttpFileCache::Find(string_view uri)
+{
+    if(maxEntries == 0)
+        return nullptr;
+
+    size_t hash = std::hash<string_view>()(uri);
+    Shard& shard = shards[hash % ShardCount];
+    auto now = steady_clock::now();
+
+    shared_ptr<const Entry> entry;
+    bool expired;
+    {
+        lock_guard<Spinlock> lk(shard.lock);
+
+        auto it = shard.slots.find(hash);
+        if(it == shard.slots.end() || it->second.entry->uri != uri)
+            return nullptr;
+
+        entry = it->second.entry;
+        expired = now >= it->second.expires;
+    }
+
+    if(!expired)
+        return entry;
+
+    // checked without holding the lock, so other requests aren't held up by the file system
+    bool unchanged = entry->file.Unchanged(entry->path);
+
+    shared_ptr<const Entry> removed; // closed after the lock is released
+    {
+        lock_guard<Spinlock> lk(shard.lock);
+
+        auto it = shard.slots.find(hash);
+        if(it != shard.slots.end() && it->second.entry == entry)
+        {
+            if(unchanged) {
+                it->second.expires = now + ttl;
+            }
+            else {
+                removed = std::move(it->second.entry);
+                shard.slots.erase(it);
+            }
+        }
+    }
+
+    return unchanged ? entry : nullptr;
+}
+
+shared_ptr<const HttpFileCache::Entry> HttpFileCache::Add(string_view uri, string path, File file)
+{
+    auto entry = make_shared<Entry>();
+    entry->uri = uri;
+    entry->type = MimeTypes::TypeForPath(path);
+    entry->path = std::move(path);
+    entry->file = std::move(file);
+
+    if(maxEntries == 0)
+        return entry;
+
+    // the remainder goes to the first shards, so the shards hold no more than 'maxEntries' in total.
+    // URIs that land in a shard with no room aren't cached.
+    size_t hash = std::hash<string_view>()(uri);
+    size_t shardIndex = hash % ShardCount;
+    size_t shardSize = maxEntries / ShardCount + (shardIndex < maxEntries % ShardCount ? 1 : 0);
+
+    if(shardSize == 0)
+        return entry;
+
+    Shard& shard = shards[shardIndex];
+
+    shared_ptr<const Entry> replaced; // closed after the lock is released
+    {
+        lock_guard<Spinlock> lk(shard.lock);
+
+        auto it = shard.slots.find(hash);
+        if(it == shard.slots.end() && shard.slots.size() >= shardSize)
+            it = shard.slots.begin();
+
+        if(it != shard.slots.end()) {
+            replaced = std::move(it->second.entry);
+            shard.slots.erase(it);
+        }
+
+        shard.slots.emplace(hash, Slot{ entry, steady_clock::now() + ttl });
+    }
+
+    return entry;
+}
+
+void HttpFileCache::Clear()
+{
+    for(Shard& shard : shards)
+    {
+        unordered_map<size_t, Slot> slots;
+        {
+            lock_guard<Spinlock> lk(shard.lock);
+            slots.swap(shard.slots);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+#include <system/File.h>
+#include <system/Spinlock.h>
+
+///<summary>
+///Files that were requested recently, by raw request URI, so requests for them skip
+///decoding the URI and opening the file. An entry is trusted for 'ttl' after it's added
+///or checked. After that, the next request for it checks the path with one stat(), and
+///the entry is dropped if the file changed. May be used from any thread.
+///</summary>
+class HttpFileCache
+{
+public:
+    using milliseconds = std::chrono::milliseconds;
+
+    // each entry keeps a file open, so this has to leave room for clients under the descriptor limit
+    static constexpr size_t DefaultMaxEntries = 512;
+    static constexpr milliseconds DefaultTtl = milliseconds(2000);
+
+    struct Entry
+    {
+        std::string uri;        // as it was requested
+        std::string path;       // the local path it resolved to
+        File file;              // open, and regular. Read with File::Read() or sendfile(), which don't seek.
+        std::string_view type;  // MIME type
+    };
+
+    // at most 'maxEntries' files are kept open, and zero disables the cache.
+    // Only call it while the cache isn't in use.
+    void Configure(size_t maxEntries, milliseconds ttl);
+
+    // returns null if there's no entry for 'uri', or the file changed
+    std::shared_ptr<const Entry> Find(std::string_view uri);
+
+    // makes an entry for 'file', which must be open and regular, and adds it if there's room.
+    // When the cache is full, an arbitrary entry is replaced.
+    std::shared_ptr<const Entry> Add(std::string_view uri, std::string path, File file);
+
+    // closes the cached files, once the requests that are sending them are done
+    void Clear();
+
+private:
+    using steady_clock = std::chrono::steady_clock;
+
+    static constexpr size_t ShardCount = 16;
+
+    struct Slot
+    {
+        std::shared_ptr<const Entry> entry;
+        steady_clock::time_point expires;
+    };
+
+    // keyed by the hash of the URI, which is compared once found, so lookups don't allocate
+    struct Shard
+    {
+        Spinlock lock;
+        std::unordered_map<size_t, Slot> slots;
+    };
+
+    Shard shards[ShardCount];
+    size_t maxEntries = DefaultMaxEntries;
+    milliseconds ttl = DefaultTtl;
+};
@@ -0,0 +1,345 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/http/HttpScan.h>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define HTTP_SCAN_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define SCAN_TARGET(isa)
+    #else
+        // lets the SIMD versions be compiled without raising the minimum CPU for the whole binary
+        #define SCAN_TARGET(isa) __attribute__((target(isa)))
+    #endif
+#else
+    #define HTTP_SCAN_X86 0
+#endif
+
+using namespace Http;
+
+namespace
+{
+    typedef const char* (*ScanFunction)(const char* p, const char* end);
+
+    struct ScanFunctions
+    {
+        ScanLevel level;
+        ScanFunction findNonToken;
+        ScanFunction findControl;
+    };
+
+    struct ScanTables
+    {
+        bool token[256];
+        bool control[256];
+
+        // pshufb lookup tables for 'token'. Bit 'h' of tokenLow[l] is set if (h << 4 | l) is a
+        // token character, and tokenHigh[h] selects bit 'h'. Both are repeated for each 128 bit lane.
+        alignas(32) uint8_t tokenLow[32];
+        alignas(32) uint8_t tokenHigh[32];
+
+        constexpr ScanTables() : token(), control(), tokenLow(), tokenHigh()
+        {
+            const char specials[] = "!#$%&'*+-.^_`|~";
+
+            for(int c = '0'; c <= '9'; ++c) token[c] = true;
+            for(int c = 'a'; c <= 'z'; ++c) token[c] = true;
+            for(int c = 'A'; c <= 'Z'; ++c) token[c] = true;
+            for(int i = 0; specials[i] != 0; ++i) token[(unsigned char)specials[i]] = true;
+
+            for(int c = 0; c < 0x20; ++c) control[c] = c != '\t';
+            control[0x7F] = true;
+
+            for(int i = 0; i < 32; ++i)
+            {
+                int nibble = i & 0x0F;
+
+                for(int h = 0; h < 8; ++h) {
+                    if(token[h << 4 | nibble])
+                        tokenLow[i] |= (uint8_t)(1 << h);
+                }
+
+                tokenHigh[i] = nibble < 8 ? (uint8_t)(1 << nibble) : 0;
+            }
+        }
+    };
+
+    constexpr ScanTables tables;
+
+    const char* FindNonTokenScalar(const char* p, const char* end)
+    {
+        while(p != end && tables.token[(unsigned char)*p])
+            ++p;
+
+        return p;
+    }
+
+    // true if any byte of 'word' is below 0x20 or is 0x7F. HTAB is included, so matches are checked
+    inline bool HasControl(uint64_t word)
+    {
+        const uint64_t ones = 0x0101010101010101ull;
+        const uint64_t highBits = 0x8080808080808080ull;
+        uint64_t below = (word - ones * 0x20) & ~word & highBits;
+        uint64_t del = word ^ (ones * 0x7F);
+        return (below | ((del - ones) & ~del & highBits)) != 0;
+    }
+
+    const char* FindControlScalar(const char* p, const char* end)
+    {
+        // 8 bytes at a time, then byte by byte through a word that might contain one
+        while(end - p >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+
+            if(HasControl(word))
+            {
+                for(int i = 0; i < 8; ++i) {
+                    if(tables.control[(unsigned char)p[i]])
+                        return p + i;
+                }
+            }
+
+            p += 8;
+        }
+
+        while(p != end && !tables.control[(unsigned char)*p])
+            ++p;
+
+        return p;
+    }
+
+#if HTTP_SCAN_X86
+    inline int LowestBit(uint32_t mask)
+    {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+    #else
+        return __builtin_ctz(mask);
+    #endif
+    }
+
+    // pcmpestri takes at most 8 ranges, so the last one also covers '|' and '~',
+    // which are token characters. A match is checked against the table.
+    alignas(16) const char nonTokenRanges[16] = {
+        '\x00', ' ', '"', '"', '(', ')', ',', ',', '/', '/', ':', '@', '[', ']', '{', '\xff'
+    };
+
+    constexpr int RangeFlags = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT;
+
+    SCAN_TARGET("sse4.2")
+    const char* FindNonTokenSSE42(const char* p, const char* end)
+    {
+        const __m128i ranges = _mm_load_si128((const __m128i*)nonTokenRanges);
+
+        while(end - p >= 16)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i*)p);
+            int index = _mm_cmpestri(ranges, 16, data, 16, RangeFlags);
+
+            if(index == 16) {
+                p += 16;
+                continue;
+            }
+
+            p += index;
+            if(!tables.token[(unsigned char)*p])
+                return p;
+
+            ++p;
+        }
+
+        return FindNonTokenScalar(p, end);
+    }
+
+    // returns the first byte of 'p' flagged in 'mask' that really is a control character, or null
+    inline const char* ConfirmControl(const char* p, uint32_t mask)
+    {
+        while(mask)
+        {
+            int index = LowestBit(mask);
+            if(tables.control[(unsigned char)p[index]])
+                return p + index;
+
+            mask &= mask - 1;
+        }
+
+        return nullptr;
+    }
+
+    // Control characters are found with a signed compare against 0x20, which also flags HTAB
+    // and bytes >= 0x80. Those are rare in header lines, and are filtered out by ConfirmControl().
+    // This is cheaper than an exact test, and than pcmpestri.
+    SCAN_TARGET("sse4.2")
+    const char* FindControlSSE42(const char* p, const char* end)
+    {
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i del = _mm_set1_epi8(0x7F);
+
+        while(end - p >= 16)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i*)p);
+            __m128i control = _mm_or_si128(_mm_cmpgt_epi8(space, data), _mm_cmpeq_epi8(data, del));
+
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(control);
+            if(mask)
+            {
+                if(auto found = ConfirmControl(p, mask))
+                    return found;
+            }
+
+            p += 16;
+        }
+
+        return FindControlScalar(p, end);
+    }
+
+    SCAN_TARGET("avx2")
+    const char* FindNonTokenAVX2(const char* p, const char* end)
+    {
+        const __m256i lowTable = _mm256_load_si256((const __m256i*)tables.tokenLow);
+        const __m256i highTable = _mm256_load_si256((const __m256i*)tables.tokenHigh);
+        const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+
+        while(end - p >= 32)
+        {
+            __m256i data = _mm256_loadu_si256((const __m256i*)p);
+            __m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(data, nibbleMask));
+            __m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(data, 4), nibbleMask));
+            __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero);
+
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(invalid);
+            if(mask)
+                return p + LowestBit(mask);
+
+            p += 32;
+        }
+
+        // GCC doesn't always clear the upper halves of the ymm registers before a tail call,
+        // and SSE code that runs while they're dirty is much slower
+        _mm256_zeroupper();
+        return FindNonTokenScalar(p, end);
+    }
+
+    SCAN_TARGET("avx2")
+    inline uint32_t ControlMaskAVX2(const char* p)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i*)p);
+        __m256i control = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), data),
+                                          _mm256_cmpeq_epi8(data, _mm256_set1_epi8(0x7F)));
+        return (uint32_t)_mm256_movemask_epi8(control);
+    }
+
+    SCAN_TARGET("avx2")
+    const char* FindControlAVX2(const char* p, const char* end)
+    {
+        // long lines like cookies are checked 64 bytes at a time
+        while(end - p >= 64)
+        {
+            uint32_t mask0 = ControlMaskAVX2(p);
+            uint32_t mask1 = ControlMaskAVX2(p + 32);
+
+            if(mask0 | mask1)
+            {
+                if(auto found = ConfirmControl(p, mask0))
+                    return found;
+
+                if(auto found = ConfirmControl(p + 32, mask1))
+                    return found;
+            }
+
+            p += 64;
+        }
+
+        if(end - p >= 32)
+        {
+            if(uint32_t mask = ControlMaskAVX2(p))
+            {
+                if(auto found = ConfirmControl(p, mask))
+                    return found;
+            }
+
+            p += 32;
+        }
+
+        _mm256_zeroupper();
+        return FindControlScalar(p, end);
+    }
+
+    const ScanFunctions levels[] = {
+        { ScanLevel::Scalar, &FindNonTokenScalar, &FindControlScalar },
+        { ScanLevel::SSE42, &FindNonTokenSSE42, &FindControlSSE42 },
+        { ScanLevel::AVX2, &FindNonTokenAVX2, &FindControlAVX2 },
+    };
+
+    ScanLevel GetSupportedLevel()
+    {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool sse42 = (info[2] & (1 << 20)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx2 = false;
+
+        // the OS has to save the upper halves of the ymm registers too
+        if(maxLeaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+    #else
+        __builtin_cpu_init();
+        bool sse42 = __builtin_cpu_supports("sse4.2");
+        bool avx2 = __builtin_cpu_supports("avx2");
+    #endif
+
+        return avx2 ? ScanLevel::AVX2 : sse42 ? ScanLevel::SSE42 : ScanLevel::Scalar;
+    }
+#else
+    const ScanFunctions levels[] = {
+        { ScanLevel::Scalar, &FindNonTokenScalar, &FindControlScalar },
+    };
+
+    ScanLevel GetSupportedLevel() {
+        return ScanLevel::Scalar;
+    }
+#endif
+
+    const ScanLevel supportedLevel = GetSupportedLevel();
+    std::atomic<const ScanFunctions*> selected = &levels[(int)supportedLevel];
+}
+
+namespace Http
+{
+    ScanLevel GetScanLevel() {
+        return selected.load(std::memory_order_relaxed)->level;
+    }
+
+    ScanLevel SetScanLevel(ScanLevel level)
+    {
+        level = std::min(level, supportedLevel);
+        selected = &levels[(int)level];
+        return level;
+    }
+
+    const char* FindNonToken(const char* p, const char* end) {
+        return selected.load(std::memory_order_relaxed)->findNonToken(p, end);
+    }
+
+    const char* FindControl(const char* p, const char* end) {
+        return selected.load(std::memory_order_relaxed)->findControl(p, end);
+    }
+}
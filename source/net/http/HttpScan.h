@@ -0,0 +1,32 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstddef>
+
+// Byte scans used by the request parser. Each one has a scalar, an SSE4.2
+// and an AVX2 version, and the best one the CPU supports is picked at startup.
+namespace Http
+{
+    enum class ScanLevel
+    {
+        Scalar,
+        SSE42,  // 16 bytes at a time
+        AVX2    // 32 bytes at a time
+    };
+
+    // the instruction set in use
+    ScanLevel GetScanLevel();
+
+    // uses 'level', or the best level supported if 'level' isn't. Returns the level in use.
+    ScanLevel SetScanLevel(ScanLevel level);
+
+    // returns the first byte in [p, end) that isn't a token character (RFC 7230 tchar), or 'end'
+    const char* FindNonToken(const char* p, const char* end);
+
+    // returns the first control character in [p, end) other than HTAB, or 'end'.
+    // In a valid header line, that's the CR or LF that ends it.
+    const char* FindControl(const char* p, const char* end);
+}
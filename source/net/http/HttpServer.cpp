@@ -9,6 +9,7 @@
 #include <system/format.h>
 #include <system/Spinlock.h>
 #include <system/Console.h>
+#include <system/File.h>
 #include <iostream>
 #include <chrono>
 #include <fstream>
@@ -16,6 +17,7 @@
 #include <iomanip>
 #include <atomic>
 #include <queue>
+#include <stdexcept>
 
 using namespace std;
 using namespace chrono;
@@ -31,7 +33,20 @@ HttpServer::~HttpServer()
     Socket::ShutdownSystem();
 }
 
-void HttpServer::Start(int port, const string& docsPath, size_t threadCount)
+void HttpServer::Start(int port, const string& docsPath, size_t threadCount, SocketEngine engine)
+{
+    if (threadCount == 0)
+        threadCount = thread::hardware_concurrency();
+
+    // a fixed number of workers is just a range that can't scale
+    WorkerScaling fixed;
+    fixed.minWorkers = threadCount;
+    fixed.maxWorkers = threadCount;
+
+    Start(port, docsPath, fixed, engine);
+}
+
+void HttpServer::Start(int port, const string& docsPath, const WorkerScaling& scaling, SocketEngine engine)
 {
     Stop();
 
@@ -46,14 +61,45 @@ void HttpServer::Start(int port, const string& docsPath, size_t threadCount)
         if(this->httpdocs.back() == '\\')
             this->httpdocs.pop_back();
 
+        cannedResponses.Build(this->httpdocs, errorPages);
+        fileCache.Configure(fileCacheEntries, fileCacheTtl);
+
+        SocketController::instance.SetEngine(engine);
+
+        this->scaling = scaling;
+
+        if (this->scaling.maxWorkers == 0)
+            this->scaling.maxWorkers = std::max(thread::hardware_concurrency(), 1u);
+
+        this->scaling.minWorkers = std::clamp(this->scaling.minWorkers, (size_t)1, this->scaling.maxWorkers);
+
+        perWorkerListeners = (acceptMode == HttpAcceptMode::PerWorker);
+
+#ifndef __linux__
+        if (perWorkerListeners) {
+            Console::WriteLine("per-worker listeners need SO_REUSEPORT load balancing, using a shared listener");
+            perWorkerListeners = false;
+        }
+#endif
+
         // create worker threads to handle incoming requests
-        auto threadCount = thread::hardware_concurrency();
+        for (size_t i = 0; i < this->scaling.minWorkers; ++i)
+            AddWorker();
 
-        for (size_t i = 0; i < threadCount; ++i)
-            requestThreads.push_back(std::thread(&HttpServer::RequestDispatchEntryPoint, this));
+        if (this->scaling.minWorkers < this->scaling.maxWorkers)
+        {
+            lastScalingSample = steady_clock::now();
+            quietIntervals = 0;
+            scalingTimer.Start(this->scaling.interval, &HttpServer::OnScalingTimer, this);
+        }
+
+        if (!perWorkerListeners)
+        {
+            OpenListener(listenSocket, false);
 
-        // start a looping coroutine to accept incoming connections and add them to the queue
-        ListenForConnections();
+            // start a looping coroutine to accept incoming connections and add them to the queue
+            ListenForConnections();
+        }
     }
     catch(exception&)
     {
@@ -67,15 +113,26 @@ void HttpServer::Stop()
     if(run)
     {
         run = false;
+        scalingTimer.Cancel();
         listenSocket.Close();
 
         turnstyle.PermitAll();
 
-        for (int i = 0; i < requestThreads.size(); ++i)
-            requestThreads[i].join();
+        for (auto& worker : workers)
+        {
+            worker->dispatcher->InvokeAsync([](auto p, auto n) {
+                ((Worker*)p)->listenSocket.Close();
+                Dispatcher::current().Quit();
+            }, worker.get());
+        }
+
+        for (auto& worker : workers)
+            worker->thread.join();
 
-        requestThreads.clear();
+        workers.clear();
+        activeWorkers = 0;
         clientSockets.clear();
+        fileCache.Clear();
 
         port = 0;
         httpdocs.clear();
@@ -84,53 +141,302 @@ void HttpServer::Stop()
     }
 }
 
-Task<void> HttpServer::ListenForConnections()
+size_t HttpServer::GetWorkerCount() const {
+    return activeWorkers;
+}
+
+void HttpServer::SetAcceptMode(HttpAcceptMode mode) {
+    acceptMode = mode;
+}
+
+HttpAcceptMode HttpServer::GetAcceptMode() const {
+    return acceptMode;
+}
+
+void HttpServer::SetFileCache(size_t maxEntries, milliseconds ttl)
 {
-    try
+    fileCacheEntries = maxEntries;
+    fileCacheTtl = ttl;
+}
+
+void HttpServer::SetErrorPage(HttpStatus status, const string& path)
+{
+    if (!HttpCannedResponses::IsError(status))
+        throw std::invalid_argument("error pages can only be set for 4xx and 5xx statuses");
+
+    if (path.empty())
+        errorPages.erase(status);
+    else
+        errorPages[status] = path;
+}
+
+void HttpServer::AddWorker()
+{
+    auto worker = std::make_unique<Worker>(this);
+
+    if (perWorkerListeners)
+        OpenListener(worker->listenSocket, true);
+
+    // wait for the worker's dispatcher to exist, so it can be posted to
+    std::promise<Dispatcher*> started;
+    worker->thread = std::thread(&HttpServer::RequestDispatchEntryPoint, this, worker.get(), &started);
+    worker->dispatcher = started.get_future().get();
+
+    workers.push_back(std::move(worker));
+    ++activeWorkers;
+}
+
+void HttpServer::OnScalingTimer(void* server, intmax_t)
+{
+    auto self = (HttpServer*)server;
+    self->ScaleWorkers();
+    self->scalingTimer.Start(self->scaling.interval, &HttpServer::OnScalingTimer, self);
+}
+
+void HttpServer::ScaleWorkers()
+{
+    auto now = steady_clock::now();
+    auto elapsed = duration_cast<nanoseconds>(now - lastScalingSample);
+    lastScalingSample = now;
+
+    if (elapsed.count() <= 0)
+        return;
+
+    int64_t nowTicks = duration_cast<nanoseconds>(now.time_since_epoch()).count();
+    nanoseconds maxQueueDelay(0);
+    float maxUtilization = 0;
+
+    for (auto& worker : workers)
     {
-        listenSocket = Socket(AddressFamily::InterNetwork, SocketType::Stream, ProtocolType::TCP);
-        listenSocket.SetBlocking(false);
-        listenSocket.Bind(port);
-        listenSocket.Listen();
+        // a probe that still hasn't run has waited at least this long
+        int64_t sent = worker->probeSent;
+        nanoseconds queueDelay(sent ? nowTicks - sent : worker->queueDelay.load());
+
+        auto waitTime = worker->dispatcher->GetWaitTime();
+        float utilization = 1.0f - (float)(waitTime - worker->lastWaitTime).count() / elapsed.count();
+        worker->lastWaitTime = waitTime;
+
+        if (worker->active)
+        {
+            maxQueueDelay = std::max(maxQueueDelay, queueDelay);
+            maxUtilization = std::max(maxUtilization, std::clamp(utilization, 0.0f, 1.0f));
+        }
+
+        if (!sent)
+        {
+            worker->probeSent = nowTicks;
+            worker->dispatcher->InvokeAsync(&Worker::OnProbe, worker.get());
+        }
     }
-    catch(std::exception& ex)
+
+    bool overloaded = maxQueueDelay > scaling.maxQueueDelay || maxUtilization > scaling.maxUtilization;
+    bool quiet = maxQueueDelay < scaling.maxQueueDelay / 4 && maxUtilization < scaling.minUtilization;
+    quietIntervals = quiet ? quietIntervals + 1 : 0;
+
+    if (overloaded && activeWorkers < scaling.maxWorkers)
     {
-        Console::WriteLine("Server failed to listen: %", ex.what());
-        co_return;
+        // unpark a worker before starting a new one
+        auto it = std::find_if(workers.begin(), workers.end(), [](auto& w) { return !w->active; });
+
+        if (it != workers.end())
+        {
+            (*it)->active = true;
+            (*it)->dispatcher->InvokeAsync(&Worker::SetParked, it->get(), false);
+            ++activeWorkers;
+        }
+        else
+        {
+            AddWorker();
+        }
+
+        Console::WriteLine("added a worker, % taking connections", activeWorkers.load());
     }
-    
-    while (run)
+    else if (quietIntervals >= scaling.parkAfter && activeWorkers > scaling.minWorkers)
     {
-        try
+        // park the most recently added worker
+        auto it = std::find_if(workers.rbegin(), workers.rend(), [](auto& w) { return w->active; });
+
+        (*it)->active = false;
+        (*it)->dispatcher->InvokeAsync(&Worker::SetParked, it->get(), true);
+        --activeWorkers;
+        quietIntervals = 0;
+
+        Console::WriteLine("parked a worker, % taking connections", activeWorkers.load());
+    }
+}
+
+void HttpServer::Worker::SetParked(void* worker, intmax_t parked)
+{
+    auto self = (Worker*)worker;
+    auto server = self->server;
+    self->parked = (parked != 0);
+
+    if (self->parked)
+    {
+        if (server->perWorkerListeners) {
+            self->CloseListener();
+        }
+        else {
+            // wake GetRequests() if it's waiting for a client, so it sees 'parked' and returns
+            server->turnstyle.Release(&Dispatcher::current());
+        }
+    }
+    else
+    {
+        if (server->perWorkerListeners && !self->listenSocket.valid())
+        {
+            try {
+                server->OpenListener(self->listenSocket, true);
+            }
+            catch (exception& ex) {
+                Console::WriteLine("Server failed to listen: %", ex.what());
+                return;
+            }
+        }
+
+        // the previous loop may still be running if it was unparked before it saw 'parked'
+        if (!self->accepting)
         {
-            Socket socket = co_await listenSocket.AcceptAsync();
+            self->accepting = true;
+
+            if (server->perWorkerListeners)
+                server->ListenForConnections(self);
+            else
+                server->GetRequests(self);
+        }
+    }
+}
+
+void HttpServer::Worker::CloseListener()
+{
+    // serve the connections the kernel already queued on this socket. Ones that arrive
+    // while it's closing are reset, unless net.ipv4.tcp_migrate_req moves them elsewhere.
+    try
+    {
+        for (;;)
+        {
+            Socket socket = listenSocket.Accept();
+            if (!socket.valid())
+                break;
+
+            server->PrepareClient(socket);
+            server->AcceptRequests(this, std::move(socket));
+        }
+    }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+    }
+
+    listenSocket.Close();
+}
+
+void HttpServer::Worker::OnProbe(void* worker, intmax_t)
+{
+    auto self = (Worker*)worker;
+    int64_t nowTicks = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    self->queueDelay = nowTicks - self->probeSent;
+    self->probeSent = 0;
+}
+
+void HttpServer::Worker::OnCommonFieldsTimer(void* worker, intmax_t)
+{
+    auto self = (Worker*)worker;
+    self->commonFields.Refresh();
+
+    // just after the next second starts, so the date is never more than a tick behind
+    auto sinceSecond = system_clock::now().time_since_epoch() % seconds(1);
+    auto untilNext = duration_cast<milliseconds>(seconds(1) - sinceSecond) + milliseconds(1);
+    self->commonFieldsTimer.Start(untilNext, &Worker::OnCommonFieldsTimer, self);
+}
+
+void HttpServer::OpenListener(Socket& listener, bool reusePort)
+{
+    listener = Socket(AddressFamily::InterNetwork, SocketType::Stream, ProtocolType::TCP);
+    listener.SetBlocking(false);
+    listener.SetTcpNoDelay(true);
+
+    if (reusePort)
+        listener.SetReusePort(true);
 
-            socket.SetBlocking(false);
-            socket.SetTcpNoDelay(true);
+    // timed out connections are closed from this end and sit in TIME_WAIT,
+    // so allow rebinding while they drain (on Windows this would allow port theft)
+#ifdef _WIN32
+    listener.Bind(port);
+#else
+    listener.Bind(port, nullptr, true);
+#endif
+    listener.Listen();
+}
+
+void HttpServer::PrepareClient(Socket& socket)
+{
+    // sockets from AcceptAsync() are already non-blocking
+    if (socket.blocking())
+        socket.SetBlocking(false);
 
-            Console::WriteLine((uint64_t)socket.handle(), "client connected");
+    // Linux copies TCP_NODELAY from the listening socket
+#ifndef __linux__
+    socket.SetTcpNoDelay(true);
+#endif
+
+    Console::WriteLine((uint64_t)socket.handle(), "client connected");
+}
+
+Task<void> HttpServer::ListenForConnections(Worker* worker)
+{
+    // a worker accepts on its own socket, and serves the clients it accepts itself
+    Socket& listener = worker ? worker->listenSocket : listenSocket;
+    Socket sockets[AcceptBatchSize];
 
-            // add client socket to queue, to be picked up by a worker thread
-            EnqueueClient(std::move(socket));
+    while (run && !(worker && worker->parked))
+    {
+        try
+        {
+            int count = co_await listener.AcceptAsync(sockets, AcceptBatchSize);
+
+            for (int i = 0; i < count; ++i)
+                PrepareClient(sockets[i]);
+
+            if (worker)
+            {
+                for (int i = 0; i < count; ++i)
+                    AcceptRequests(worker, std::move(sockets[i]));
+            }
+            else
+            {
+                // add client sockets to queue, to be picked up by worker threads
+                EnqueueClients(sockets, count);
+            }
         }
         catch (exception& ex)
         {
-            Console::WriteLine(ex.what());
+            // the listener is closed when the server stops, or a worker is parked
+            if (listener.valid())
+                Console::WriteLine(ex.what());
         }
     }
+
+    if (worker)
+        worker->accepting = false;
 }
 
-void HttpServer::RequestDispatchEntryPoint()
+void HttpServer::RequestDispatchEntryPoint(Worker* worker, std::promise<Dispatcher*>* started)
 {
-    Dispatcher::current().InvokeAsync([](auto p, auto n) { ((HttpServer*)p)->GetRequests(); }, this);
-    Dispatcher::current().Run();
+    auto& dispatcher = Dispatcher::current();
+    dispatcher.InvokeAsync(&Worker::SetParked, worker, false);
+    Worker::OnCommonFieldsTimer(worker, 0);
+    started->set_value(&dispatcher);
+    dispatcher.Run();
+
+    // the timer belongs to this thread's dispatcher, which is destroyed with it
+    worker->commonFieldsTimer.Cancel();
 }
 
-Task<void> HttpServer::GetRequests()
+Task<void> HttpServer::GetRequests(Worker* worker)
 {
     try
     {
-        while (run)
+        while (run && !worker->parked)
         {
             // wait for a new client connection
             co_await turnstyle;
@@ -141,7 +447,7 @@ Task<void> HttpServer::GetRequests()
             if (run && socket.valid())
             {
                 // start a looping coroutine to process requests for this client
-                AcceptRequests(std::move(socket));
+                AcceptRequests(worker, std::move(socket));
             }
         }
     }
@@ -150,14 +456,18 @@ Task<void> HttpServer::GetRequests()
         Console::WriteLine(ex.what());
     }
 
-    Dispatcher::current().Quit();
+    // Stop() quits the worker's dispatcher
+    worker->accepting = false;
 }
 
-void HttpServer::EnqueueClient(Socket socket)
+void HttpServer::EnqueueClients(Socket* sockets, int count)
 {
     std::lock_guard<mutex> lk(mut);
-    clientSockets.push_back(std::move(socket));
-    turnstyle.PermitOne();
+
+    for (int i = 0; i < count; ++i) {
+        clientSockets.push_back(std::move(sockets[i]));
+        turnstyle.PermitOne();
+    }
 }
 
 Socket HttpServer::GetNextClient()
@@ -174,121 +484,305 @@ Socket HttpServer::GetNextClient()
     return socket;
 }
 
-Task<void> HttpServer::AcceptRequests(Socket socket)
+void HttpServer::SetTimeouts(const Timeouts& timeouts)
+{
+    std::lock_guard<mutex> lk(mut);
+    this->timeouts = timeouts;
+}
+
+HttpServer::Timeouts HttpServer::GetTimeouts() const
+{
+    std::lock_guard<mutex> lk(mut);
+    return timeouts;
+}
+
+void HttpServer::SetMaxHeaderSize(size_t size)
+{
+    std::lock_guard<mutex> lk(mut);
+    maxHeaderSize = size;
+}
+
+size_t HttpServer::GetMaxHeaderSize() const
+{
+    std::lock_guard<mutex> lk(mut);
+    return maxHeaderSize;
+}
+
+uint64_t HttpServer::GetTimeoutCount(HttpTimeoutReason reason) const {
+    return timeoutCounts[(int)reason];
+}
+
+HttpServer::Connection::Connection(HttpServer* server, const HttpCommonFields& commonFields, Socket socket)
+    : server(server), commonFields(commonFields), socket(std::move(socket)), timeouts(server->GetTimeouts()),
+      parser(server->GetMaxHeaderSize())
+{
+}
+
+void HttpServer::Connection::SetDeadline(HttpTimeoutReason reason)
 {
+    milliseconds length;
+
+    switch (reason)
+    {
+    case HttpTimeoutReason::Idle: length = timeouts.idle; break;
+    case HttpTimeoutReason::HeaderRead: length = timeouts.headerRead; break;
+    default: length = timeouts.bodySend; break;
+    }
+
+    timer.Start(length, &Connection::OnDeadline, this, (intmax_t)reason);
+}
+
+void HttpServer::Connection::ClearDeadline() {
+    timer.Cancel();
+}
+
+void HttpServer::Connection::OnDeadline(void* connection, intmax_t reason)
+{
+    static const char* reasonNames[] = { "idle", "header read", "body send" };
+
+    auto self = (Connection*)connection;
+    ++self->server->timeoutCounts[reason];
+
+    Console::WriteLine((uint64_t)self->socket.handle(), "% timeout, closing connection", reasonNames[reason]);
+    self->closed = true;
+    self->socket.Shutdown();
+}
+
+Task<void> HttpServer::AcceptRequests(Worker* worker, Socket clientSocket)
+{
+    Connection connection(this, worker->commonFields, std::move(clientSocket));
+    Socket& socket = connection.socket;
+
     try
     {
-        time_point timeout = steady_clock::time_point::min();
         bool keepAlive = true;
-        std::vector<char> requestBuffer;
+        bool firstRequest = true;
+        bool linger = false; // unread data is left, see Linger()
+        HttpRequestParser& parser = connection.parser;
+        const HttpRequestView& req = parser.request(); // points into the parser's buffer
 
         while (keepAlive)
         {
-            requestBuffer.resize(BufferSize);
-            
-            Console::WriteLine((uint64_t)socket.handle(), "waiting for request");
-            
-            int received = co_await socket.RecvAsync(requestBuffer.data(), requestBuffer.size());
-            if (received == 0)
+            // a pipelined request may have been received along with the last one
+            auto result = parser.Next();
+
+            if (result == HttpRequestParser::Result::Incomplete)
+            {
+                // the responses to the requests received so far go out before waiting for more
+                if (!connection.queued.empty())
+                {
+                    co_await Flush(connection);
+                    if (connection.closed)
+                        break;
+                }
+
+                Console::WriteLine((uint64_t)socket.handle(), "waiting for request");
+
+                // a kept-alive connection is idle until the next request starts arriving. From then on,
+                // there's one deadline for the whole header, however many pieces it arrives in.
+                bool reading = firstRequest || parser.buffered() > 0;
+                connection.SetDeadline(reading ? HttpTimeoutReason::HeaderRead : HttpTimeoutReason::Idle);
+
+                while (result == HttpRequestParser::Result::Incomplete)
+                {
+                    size_t space;
+                    char* buffer = parser.Prepare(space);
+
+                    int received = co_await socket.RecvAsync(buffer, space);
+                    if (received == 0)
+                        break;
+
+                    result = parser.Commit(received);
+
+                    if (!reading && result == HttpRequestParser::Result::Incomplete && parser.buffered() > 0) {
+                        connection.SetDeadline(HttpTimeoutReason::HeaderRead);
+                        reading = true;
+                    }
+                }
+
+                connection.ClearDeadline();
+            }
+
+            firstRequest = false;
+
+            if (result == HttpRequestParser::Result::Incomplete)
             {
                 Console::WriteLine((uint64_t)socket.handle(), "client disconnected");
                 break;
             }
 
-            requestBuffer.resize(received);
-
-            HttpRequest req;
+            // the rest of the stream can't be trusted after these, so the connection is closed
+            if (result == HttpRequestParser::Result::TooLarge) {
+                Console::WriteLine((uint64_t)socket.handle(), "request header too large");
+                keepAlive = false;
+                linger = true;
+                co_await SendError(connection, HttpStatus::RequestHeaderFieldsTooLarge, keepAlive);
+                continue;
+            }
 
-            if (!req.Parse(requestBuffer)) {
+            if (result == HttpRequestParser::Result::Invalid) {
                 Console::WriteLine((uint64_t)socket.handle(), "bad request");
-                co_await SendError(socket, HttpStatus::BadRequest, keepAlive);
+                keepAlive = false;
+                linger = true;
+                co_await SendError(connection, HttpStatus::BadRequest, keepAlive);
                 continue;
             }
 
+            // bodies aren't read, so one would be taken for the next request. That includes a body sent
+            // with a GET, which could otherwise smuggle in a request, so the connection is closed after either.
+            auto bodyLength = req.Find(HttpField::ContentLength);
+            bool hasBody = req.fields.Contains(HttpField::TransferEncoding) || (!bodyLength.empty() && bodyLength != "0");
+
             if (req.method != HttpMethod::Get) {
                 Console::WriteLine((uint64_t)socket.handle(), "method not allowed");
-                co_await SendError(socket, HttpStatus::MethodNotAllowed, keepAlive);
+
+                if (hasBody) {
+                    keepAlive = false;
+                    linger = true;
+                }
+
+                co_await SendError(connection, HttpStatus::MethodNotAllowed, keepAlive);
                 continue;
             }
 
-            auto connection = req.fields.find("Connection");
-            if (connection != req.fields.end() && connection->second == "close")
-            {
-                Console::WriteLine((uint64_t)socket.handle(), "Connection: close");
+            if (hasBody) {
+                Console::WriteLine((uint64_t)socket.handle(), "GET request with a body");
                 keepAlive = false;
+                linger = true;
+                co_await SendError(connection, HttpStatus::BadRequest, keepAlive);
+                continue;
             }
 
-            string localPath = httpdocs + Http::DecodeURL(req.uri);
-            if (localPath.back() == '/')
-                localPath += defaultPage;
-
-#ifdef _WIN32
-            for (char& ch : localPath)
+            if (Http::ContainsToken(req.Find(HttpField::Connection), "close"))
             {
-                if (ch == '/')
-                    ch = '\\';
+                Console::WriteLine((uint64_t)socket.handle(), "Connection: close");
+                keepAlive = false;
             }
-#endif
 
             Console::WriteLine((uint64_t)socket.handle(), "requested file - %", req.uri);
 
-            ifstream fin(localPath, ios::in | ios::binary);
-            if (!fin.is_open()) {
-                Console::WriteLine((uint64_t)socket.handle(), "file not found - %", req.uri);
-                co_await SendError(socket, HttpStatus::NotFound, keepAlive);
-                continue;
+            // regular files are sent with sendfile(), and cached by URI. Anything else is read through a stream.
+            shared_ptr<const HttpFileCache::Entry> cached;
+            if (SOCKET_SENDFILE_SUPPORTED)
+                cached = fileCache.Find(req.uri);
+
+            string localPath;
+            ifstream fin;
+            size_t fileSize = 0;
+
+            if (!cached)
+            {
+                localPath = httpdocs + Http::DecodeURL(req.uri);
+                if (localPath.back() == '/')
+                    localPath += defaultPage;
+
+#ifdef _WIN32
+                for (char& ch : localPath)
+                {
+                    if (ch == '/')
+                        ch = '\\';
+                }
+#endif
             }
 
-            fin.seekg(0, ios::end);
-            size_t fileSize = (size_t)fin.tellg();
-            fin.seekg(0, ios::beg);
+            File file;
 
-            auto fileExtension = localPath.substr(localPath.find_last_of(".") + 1);
+            if (cached)
+            {
+                fileSize = (size_t)cached->file.size();
+            }
+            else if (SOCKET_SENDFILE_SUPPORTED && file.Open(localPath) && file.regular())
+            {
+                cached = fileCache.Add(req.uri, localPath, std::move(file));
+                fileSize = (size_t)cached->file.size();
+            }
+            else
+            {
+                file.Close();
+
+                // relative links in the directory's index only work if the URL ends with '/'
+                if (File::IsDirectory(localPath)) {
+                    Console::WriteLine((uint64_t)socket.handle(), "redirecting to directory - %", req.uri);
+                    string location(req.uri);
+                    location += '/';
+                    co_await SendRedirect(connection, HttpStatus::MovedPermanently, location, keepAlive);
+                    continue;
+                }
+
+                fin.open(localPath, ios::in | ios::binary);
+                if (!fin.is_open()) {
+                    Console::WriteLine((uint64_t)socket.handle(), "file not found - %", req.uri);
+                    co_await SendError(connection, HttpStatus::NotFound, keepAlive);
+                    continue;
+                }
+
+                fin.seekg(0, ios::end);
+                fileSize = (size_t)fin.tellg();
+                fin.seekg(0, ios::beg);
+            }
 
             vector<Http::ContentRange> ranges;
 
-            auto rangeField = req.fields.find("Range");
-            if (rangeField != req.fields.end())
-                ranges = Http::ParseRange(rangeField->second);
+            auto rangeField = req.Find(HttpField::Range);
+            if (!rangeField.empty())
+                ranges = Http::ParseRange(rangeField);
 
             size_t rangeStart;
             size_t rangeEnd;
             int hasRanges = GetRangeInfo(ranges, fileSize, &rangeStart, &rangeEnd);
 
             HttpResponse resp;
-            resp.fields["Content-Type"] = MimeTypes::TypeFor(fileExtension);
-            resp.fields["Content-Encoding"] = "identity";
-            resp.fields["Connection"] = keepAlive ? "keep-alive" : "close";
-            resp.fields["Accept-Ranges"] = "bytes";
+            resp.fields.Set(HttpField::ContentType, string(cached ? cached->type : MimeTypes::TypeForPath(localPath)));
+            resp.fields.Set(HttpField::ContentEncoding, "identity");
+            resp.fields.Set(HttpField::Connection, keepAlive ? "keep-alive" : "close");
+            resp.fields.Set(HttpField::AcceptRanges, "bytes");
 
+            size_t contentOffset = 0;
             size_t contentLength = 0;
 
             if (hasRanges == 1)
             {
+                contentOffset = rangeStart;
                 contentLength = rangeEnd - rangeStart + 1;
                 resp.status = HttpStatus::PartialContent;
-                resp.fields["Content-Length"] = to_string(contentLength);
-                resp.fields["Content-Range"] = format("bytes %-%/%", rangeStart, rangeEnd, fileSize);
-                fin.seekg(rangeStart);
+                resp.fields.Set(HttpField::ContentLength, (uint64_t)contentLength);
+                char contentRange[Http::MaxContentRangeSize];
+                size_t contentRangeSize = Http::FormatContentRange(contentRange, rangeStart, rangeEnd, fileSize);
+                resp.fields.Set(HttpField::ContentRange, string(contentRange, contentRangeSize));
+                
+                if (fin.is_open())
+                    fin.seekg(rangeStart);
             }
             else if (hasRanges == 0)
             {
                 contentLength = fileSize;
                 resp.status = HttpStatus::OK;
-                resp.fields["Content-Length"] = to_string(contentLength);
+                resp.fields.Set(HttpField::ContentLength, (uint64_t)contentLength);
             }
             else // hasRanges == -1
             {
                 Console::WriteLine((uint64_t)socket.handle(), "range not satisfiable");
-                co_await SendError(socket, HttpStatus::RequestedRangeNotSatisfiable, keepAlive);
+                co_await SendError(connection, HttpStatus::RequestedRangeNotSatisfiable, keepAlive);
                 continue;
             }
 
-            co_await SendFile(socket, std::move(resp), std::move(fin), contentLength);
+            if (cached)
+                co_await SendFile(connection, std::move(resp), std::move(cached), contentOffset, contentLength);
+            else
+                co_await SendFile(connection, std::move(resp), std::move(fin), contentLength);
+
+            if (connection.closed)
+                break;
 
             Console::WriteLine((uint64_t)socket.handle(), "successfully sent file - %", req.uri);
         }
 
+        if (!connection.queued.empty() && !connection.closed)
+            co_await Flush(connection);
+
+        if (linger && !connection.closed)
+            co_await Linger(connection);
+
         Console::WriteLine((uint64_t)socket.handle(), "exited request loop");
     }
     catch (exception& ex) {
@@ -296,73 +790,268 @@ Task<void> HttpServer::AcceptRequests(Socket socket)
     }
 }
 
-Task<void> HttpServer::SendError(Socket& socket, HttpStatus status, bool keepAlive)
+Task<void> HttpServer::SendError(Connection& connection, HttpStatus status, bool keepAlive)
 {
+    Socket& socket = connection.socket;
+
     try
     {
         Console::WriteLine((uint64_t)socket.handle(), "Send Error");
-        std::vector<char> buffer;
-        auto resp = HttpResponse::Create(status, keepAlive);
-        resp.Serialize(buffer);
+        auto response = cannedResponses.Error(status, keepAlive);
+        // copied, as the Date field can be refreshed while the response is being sent
+        auto& header = connection.header;
+        auto commonFields = connection.commonFields.block();
+        header.assign(commonFields.begin(), commonFields.end());
+
+        SocketBuffer buffers[] = {
+            SocketBuffer(response.statusLine.data(), response.statusLine.size()),
+            SocketBuffer(header.data(), header.size()),
+            SocketBuffer(response.rest.data(), response.rest.size())
+        };
+
+        co_await Send(connection, buffers, 3, true);
+    }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+        connection.closed = true;
+    }
+
+    connection.ClearDeadline();
+}
 
-        // send response (buffer already includes body)
-        const char* bufferPtr = buffer.data();
-        size_t bufferSize = buffer.size();
+Task<void> HttpServer::SendRedirect(Connection& connection, HttpStatus status, string_view location, bool keepAlive)
+{
+    Socket& socket = connection.socket;
 
-        while (bufferSize != 0)
-        {
-            int sent = co_await socket.SendAsync(bufferPtr, bufferSize);
-            bufferPtr += sent;
-            bufferSize -= sent;
-        }
+    try
+    {
+        Console::WriteLine((uint64_t)socket.handle(), "Send Redirect");
+        auto response = cannedResponses.Redirect(status, keepAlive);
+        // copied, as the Date field can be refreshed while the response is being sent
+        auto& header = connection.header;
+        auto commonFields = connection.commonFields.block();
+        header.assign(commonFields.begin(), commonFields.end());
+
+        SocketBuffer buffers[] = {
+            SocketBuffer(response.statusLine.data(), response.statusLine.size()),
+            SocketBuffer(header.data(), header.size()),
+            SocketBuffer(response.rest.data(), response.rest.size()),
+            SocketBuffer(location.data(), location.size()),
+            SocketBuffer(HttpCannedResponses::RedirectEnd.data(), HttpCannedResponses::RedirectEnd.size())
+        };
+
+        co_await Send(connection, buffers, 5, true);
+    }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+        connection.closed = true;
+    }
+
+    connection.ClearDeadline();
+}
+
+Task<void> HttpServer::Send(Connection& connection, SocketBuffer* buffers, int count, bool last)
+{
+    auto& queued = connection.queued;
+
+    size_t size = 0;
+    for (int i = 0; i < count; ++i)
+        size += buffers[i].size;
+
+    if (last && connection.parser.pipelined() && queued.size() + size <= MaxQueuedBytes)
+    {
+        for (int i = 0; i < count; ++i)
+            queued.insert(queued.end(), buffers[i].data, buffers[i].data + buffers[i].size);
+
+        co_return;
+    }
+
+    connection.SetDeadline(HttpTimeoutReason::BodySend);
+
+    if (queued.empty())
+    {
+        co_await connection.socket.SendvAsync(buffers, count);
+    }
+    else
+    {
+        SocketBuffer all[MaxSendBuffers + 1] = { SocketBuffer(queued.data(), queued.size()) };
+        assert(count <= MaxSendBuffers);
+
+        for (int i = 0; i < count; ++i)
+            all[i + 1] = buffers[i];
+
+        co_await connection.socket.SendvAsync(all, count + 1);
+        queued.clear();
+    }
+}
+
+Task<void> HttpServer::Flush(Connection& connection)
+{
+    try
+    {
+        co_await Send(connection, nullptr, 0, false);
+    }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+        connection.closed = true;
+    }
+
+    connection.ClearDeadline();
+}
+
+Task<void> HttpServer::Linger(Connection& connection)
+{
+    Socket& socket = connection.socket;
+
+    try
+    {
+        char discard[1024];
+
+        // the client sees the end of the response, and should close its end
+        socket.ShutdownSend();
+        connection.SetDeadline(HttpTimeoutReason::Idle);
+
+        while (co_await socket.RecvAsync(discard, sizeof(discard)) > 0)
+            ;
     }
     catch (exception& ex) {
         Console::WriteLine(ex.what());
     }
+
+    connection.ClearDeadline();
 }
 
-Task<void> HttpServer::SendFile(Socket& socket, HttpResponse response, std::ifstream fin, size_t contentLength)
+Task<void> HttpServer::SendFile(Connection& connection, HttpResponse response, std::ifstream fin, size_t contentLength)
 {
+    Socket& socket = connection.socket;
+
+    auto& header = connection.header;
+    response.SerializeHeader(header, connection.commonFields.block());
+
     std::vector<char> buffer;
-    response.Serialize(buffer);
     
     Console::WriteLine((uint64_t)socket.handle(), "sending response..");
 
-    // send response header
+    try
     {
-        const char* bufferPtr = buffer.data();
-        size_t bufferSize = buffer.size();
+        // the header goes out with the first part of the body
+        SocketBuffer buffers[2] = { SocketBuffer(header.data(), header.size()) };
+        int count = 1;
 
-        while (bufferSize != 0)
+        do
         {
-            int sent = co_await socket.SendAsync(bufferPtr, bufferSize);
-            bufferPtr += sent;
-            bufferSize -= sent;
+            size_t readCount = std::min(BufferSize, contentLength);
+            if (readCount != 0)
+            {
+                buffer.resize(readCount);
+                contentLength -= readCount;
+
+                if(!fin.read(buffer.data(), readCount)) {
+                    Console::WriteLine((uint64_t)socket.handle(), "failed to read from file");
+                    connection.closed = true;
+                    break;
+                }
+
+                buffers[count++] = SocketBuffer(buffer.data(), readCount);
+            }
+
+            co_await Send(connection, buffers, count, contentLength == 0);
+            count = 0;
         }
+        while (contentLength > 0);
     }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+        connection.closed = true;
+    }
+
+    connection.ClearDeadline();
+}
+
+Task<void> HttpServer::SendFile(Connection& connection, HttpResponse response, shared_ptr<const HttpFileCache::Entry> cached, size_t offset, size_t contentLength)
+{
+    const File& file = cached->file;
+    Socket& socket = connection.socket;
+
+    auto& header = connection.header;
+    response.SerializeHeader(header, connection.commonFields.block());
+
+    std::vector<char> buffer;
 
-    // send response body (the file)
-    while (contentLength > 0)
+    Console::WriteLine((uint64_t)socket.handle(), "sending response..");
+
+    try
     {
-        size_t readCount = std::min(BufferSize, contentLength);
-        buffer.resize(readCount);
-        contentLength -= readCount;
-        
-        if(!fin.read(buffer.data(), readCount)) {
-            Console::WriteLine((uint64_t)socket.handle(), "failed to read from file");
-            co_return;
-        }
+        SocketBuffer buffers[2] = { SocketBuffer(header.data(), header.size()) };
+        int count = 1;
 
-        const char* bufferPtr = buffer.data();
-        size_t bufferSize = buffer.size();
+        // the body is sent from the page cache with sendfile(). A body that fits in 'buffer'
+        // is read in instead, so it can go out with the header in one call, and so is the
+        // rest of the body if the file system doesn't support sendfile().
+        bool zeroCopy = contentLength > BufferSize;
 
-        while (bufferSize != 0)
+        while (true)
         {
-            int sent = co_await socket.SendAsync(bufferPtr, bufferSize);
-            bufferPtr += sent;
-            bufferSize -= sent;
+            if (!zeroCopy && contentLength > 0)
+            {
+                buffer.resize(std::min(BufferSize, contentLength));
+
+                // the file was truncated after its size was taken
+                int64_t readCount = file.Read(buffer.data(), buffer.size(), offset);
+                if (readCount <= 0) {
+                    Console::WriteLine((uint64_t)socket.handle(), "failed to read from file");
+                    connection.closed = true;
+                    break;
+                }
+
+                buffers[count++] = SocketBuffer(buffer.data(), (size_t)readCount);
+                offset += (size_t)readCount;
+                contentLength -= (size_t)readCount;
+            }
+
+            if (count != 0)
+            {
+                co_await Send(connection, buffers, count, contentLength == 0);
+                count = 0;
+            }
+
+            if (contentLength == 0)
+                break;
+
+            if (zeroCopy)
+            {
+                connection.SetDeadline(HttpTimeoutReason::BodySend);
+                size_t sent = 0;
+
+                try {
+                    sent = co_await socket.SendFileAsync(file.handle(), offset, contentLength);
+                }
+                catch (socket_error& ex)
+                {
+                    if (ex.error() != EINVAL && ex.error() != ENOSYS)
+                        throw;
+
+                    zeroCopy = false;
+                    continue;
+                }
+
+                if (sent == 0) {
+                    Console::WriteLine((uint64_t)socket.handle(), "failed to read from file");
+                    connection.closed = true;
+                    break;
+                }
+
+                offset += sent;
+                contentLength -= sent;
+            }
         }
     }
+    catch (exception& ex) {
+        Console::WriteLine(ex.what());
+        connection.closed = true;
+    }
+
+    connection.ClearDeadline();
 }
 
 int HttpServer::GetRangeInfo(std::vector<Http::ContentRange>& ranges, size_t fileSize, size_t* rangeStart, size_t* rangeEnd)
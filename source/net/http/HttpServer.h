@@ -10,47 +10,185 @@
 #include <atomic>
 #include <vector>
 #include <deque>
+#include <map>
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <chrono>
 #include <iomanip>
 #include <cassert>
+#include <memory>
+#include <future>
 #include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
 #include <net/http/Http.h>
+#include <net/http/HttpCannedResponses.h>
+#include <net/http/HttpCommonFields.h>
+#include <net/http/HttpFileCache.h>
 #include <system/Dispatcher.h>
 #include <system/Turnstyle.h>
+#include <system/File.h>
+
+enum class HttpTimeoutReason
+{
+    Idle,       // a kept-alive connection didn't send its next request in time
+    HeaderRead, // a new connection didn't send its first request in time
+    BodySend,   // a response made no progress in time
+
+    Count
+};
+
+enum class HttpAcceptMode
+{
+    Shared,     // one listening socket on the dispatcher that called Start(), which hands clients to workers
+    PerWorker,  // each worker accepts on its own SO_REUSEPORT socket (Linux only, otherwise Shared is used)
+};
 
 class HttpServer
 {
     using milliseconds = std::chrono::milliseconds;
 
     static constexpr size_t BufferSize = 8192;
-    static constexpr int RequestWakePort = 32190;
-    static constexpr int SendWakePort = 32191;
-    static constexpr char* LoopbackAddress = "127.0.0.1";
+    static constexpr size_t MaxQueuedBytes = 65536;
+    static constexpr int MaxSendBuffers = 5; // passed to a single Send()
+    static constexpr int AcceptBatchSize = 32;
     static constexpr milliseconds SessionTimeout = milliseconds(5000);
     static constexpr milliseconds MaxTimeSlice = milliseconds(20);
 
+public:
+    struct Timeouts
+    {
+        milliseconds idle = SessionTimeout;
+        milliseconds headerRead = milliseconds(10000);
+        milliseconds bodySend = milliseconds(30000);
+    };
+
+    ///<summary>
+    ///Bounds for the adaptive worker mode. Every 'interval', each worker's queue delay
+    ///(how long a request waits before its dispatcher gets to it) and utilization
+    ///(fraction of the interval it wasn't blocked waiting) are sampled. A worker is
+    ///added when any worker is over a limit, and one is parked after 'parkAfter'
+    ///intervals in which all of them were well under.
+    ///</summary>
+    struct WorkerScaling
+    {
+        size_t minWorkers = 1;
+        size_t maxWorkers = 0; // zero for std::thread::hardware_concurrency()
+        milliseconds interval = milliseconds(250);
+        std::chrono::microseconds maxQueueDelay = std::chrono::microseconds(2000);
+        float maxUtilization = 0.75f;
+        float minUtilization = 0.25f;
+        int parkAfter = 8;
+    };
+
+private:
+    // a client connection, owned by the coroutine serving it
+    struct Connection
+    {
+        HttpServer* server;
+        const HttpCommonFields& commonFields; // the worker's
+        Socket socket;
+        Timeouts timeouts;
+        DispatchTimer timer;
+        HttpRequestParser parser;
+        std::vector<char> header;   // the header of the response being sent, reused between responses
+        std::vector<char> queued;   // responses to pipelined requests, not sent yet
+        bool closed = false;        // timed out, or a send failed
+
+        Connection(HttpServer* server, const HttpCommonFields& commonFields, Socket socket);
+
+        // (re)starts the deadline for 'reason'. If it expires, the socket is shut
+        // down, which completes the pending operation and ends the request loop.
+        void SetDeadline(HttpTimeoutReason reason);
+        void ClearDeadline();
+
+        static void OnDeadline(void* connection, intmax_t reason);
+    };
+
+    // a request thread. A parked worker keeps serving its connections,
+    // but stops taking new ones until it's unparked.
+    struct Worker
+    {
+        HttpServer* server;
+        std::thread thread;
+        Dispatcher* dispatcher = nullptr;
+        Socket listenSocket;        // HttpAcceptMode::PerWorker only
+        bool active = true;         // not parked, as seen by the scaling timer
+
+        // only used on the worker's thread
+        bool accepting = false;     // GetRequests() is running
+        bool parked = false;
+        HttpCommonFields commonFields;
+        DispatchTimer commonFieldsTimer; // refreshes 'commonFields' when the second changes
+
+        // queue delay probe. 'probeSent' is zero when no probe is pending
+        std::atomic<int64_t> probeSent = 0;
+        std::atomic<int64_t> queueDelay = 0;
+        std::chrono::nanoseconds lastWaitTime = std::chrono::nanoseconds(0);
+
+        Worker(HttpServer* server) : server(server) {}
+
+        void CloseListener();
+
+        static void SetParked(void* worker, intmax_t parked);
+        static void OnProbe(void* worker, intmax_t num);
+        static void OnCommonFieldsTimer(void* worker, intmax_t num);
+    };
+
     std::string defaultPage = "index.html";
     std::string httpdocs;
     int port = 0;
     std::atomic<bool> run = false;
+    HttpAcceptMode acceptMode = HttpAcceptMode::Shared;
+    bool perWorkerListeners = false; // acceptMode in effect since Start()
     Socket listenSocket;
     std::deque<Socket> clientSockets;
-    std::vector<std::thread> requestThreads;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> activeWorkers = 0;
+    WorkerScaling scaling;
+    DispatchTimer scalingTimer; // runs on the dispatcher that called Start()
+    std::chrono::steady_clock::time_point lastScalingSample;
+    int quietIntervals = 0;
     Turnstyle turnstyle;
-    std::mutex mut;
+    mutable std::mutex mut;
+    Timeouts timeouts; // guarded by 'mut'
+    size_t maxHeaderSize = HttpRequestParser::DefaultMaxHeaderSize; // guarded by 'mut'
+    std::map<HttpStatus, std::string> errorPages;
+    HttpCannedResponses cannedResponses; // built by Start(), and only read while running
+    HttpFileCache fileCache;
+    size_t fileCacheEntries = HttpFileCache::DefaultMaxEntries;
+    milliseconds fileCacheTtl = HttpFileCache::DefaultTtl;
+    std::atomic<uint64_t> timeoutCounts[(int)HttpTimeoutReason::Count] = {};
 
-    void RequestDispatchEntryPoint();
+    void AddWorker();
+    void ScaleWorkers();
+    static void OnScalingTimer(void* server, intmax_t num);
+    void RequestDispatchEntryPoint(Worker* worker, std::promise<Dispatcher*>* started);
+    void OpenListener(Socket& listener, bool reusePort);
+    static void PrepareClient(Socket& socket);
 
-    Task<void> ListenForConnections();
-    Task<void> GetRequests();
-    Task<void> AcceptRequests(Socket socket);
-    Task<void> SendError(Socket& socket, HttpStatus status, bool keepAlive);
-    Task<void> SendFile(Socket& socket, HttpResponse response, std::ifstream fin, size_t contentLength);
+    Task<void> ListenForConnections(Worker* worker = nullptr);
+    Task<void> GetRequests(Worker* worker);
+    Task<void> AcceptRequests(Worker* worker, Socket clientSocket);
+    Task<void> SendError(Connection& connection, HttpStatus status, bool keepAlive);
+    Task<void> SendRedirect(Connection& connection, HttpStatus status, std::string_view location, bool keepAlive);
 
-    void EnqueueClient(Socket socket);
+    // sends 'buffers' after any queued responses. If they're a complete response ('last'), and
+    // another request has already been received, they're queued instead, so the responses to
+    // pipelined requests go out together, up to MaxQueuedBytes at a time.
+    // throws socket_error on failure
+    Task<void> Send(Connection& connection, SocketBuffer* buffers, int count, bool last);
+
+    // sends the queued responses
+    Task<void> Flush(Connection& connection);
+
+    // closing a socket with unread data resets the connection, which can destroy the response
+    // before the client reads it. This stops sending and discards input until the client closes.
+    Task<void> Linger(Connection& connection);
+    Task<void> SendFile(Connection& connection, HttpResponse response, std::ifstream fin, size_t contentLength);
+    Task<void> SendFile(Connection& connection, HttpResponse response, std::shared_ptr<const HttpFileCache::Entry> cached, size_t offset, size_t contentLength);
+
+    void EnqueueClients(Socket* sockets, int count);
     Socket GetNextClient();
     static int GetRangeInfo(std::vector<Http::ContentRange>& ranges, size_t fileSize, size_t* rangeStart, size_t* rangeEnd);
 
@@ -59,8 +197,50 @@ public:
     HttpServer();
     ~HttpServer();
     
-    ///<summary>set 'threadCount' to zero to use std::thread::hardware_concurrency()</summary>
-    void Start(int port, const std::string& docsPath, size_t threadCount = 0);
+    ///<summary>
+    ///set 'threadCount' to zero to use std::thread::hardware_concurrency()
+    ///'engine' selects how socket operations are performed, see SocketEngine
+    ///</summary>
+    void Start(int port, const std::string& docsPath, size_t threadCount = 0, SocketEngine engine = SocketEngine::Readiness);
+
+    ///<summary>
+    ///starts with 'scaling.minWorkers' workers, and adds or parks workers as load changes.
+    ///Must be called on a running Dispatcher, which samples the workers.
+    ///</summary>
+    void Start(int port, const std::string& docsPath, const WorkerScaling& scaling, SocketEngine engine = SocketEngine::Readiness);
     
     void Stop();
+
+    // applies from the next call to Start()
+    void SetAcceptMode(HttpAcceptMode mode);
+    HttpAcceptMode GetAcceptMode() const;
+
+    // applies to connections accepted after the call
+    void SetTimeouts(const Timeouts& timeouts);
+    Timeouts GetTimeouts() const;
+
+    // applies to connections accepted after the call. Requests with a longer
+    // header are answered with 431 Request Header Fields Too Large.
+    void SetMaxHeaderSize(size_t size);
+    size_t GetMaxHeaderSize() const;
+
+    ///<summary>
+    ///sends the file at 'path', relative to the document path, as the body of 'status',
+    ///which must be a 4xx or 5xx status. Pages are read once, by the next call to Start().
+    ///An empty 'path' restores the default page.
+    ///</summary>
+    void SetErrorPage(HttpStatus status, const std::string& path);
+
+    ///<summary>
+    ///sets how many files are kept open, by request URI, and for how long they're served
+    ///before the path is checked for changes. Zero 'maxEntries' disables the cache.
+    ///Applies from the next call to Start().
+    ///</summary>
+    void SetFileCache(size_t maxEntries, milliseconds ttl);
+
+    // number of connections closed because of 'reason'
+    uint64_t GetTimeoutCount(HttpTimeoutReason reason) const;
+
+    // number of workers taking new connections
+    size_t GetWorkerCount() const;
 };
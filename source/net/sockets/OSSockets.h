@@ -18,7 +18,17 @@
     #include <unistd.h>
     #include <sys/socket.h>
     #include <poll.h>
+    #ifdef __linux__
+        #include <sys/epoll.h>
+    #endif
     #define SOCKET int
+    #define S_SHUT_RDWR               SHUT_RDWR
+    #define S_SHUT_WR                 SHUT_WR
+    #ifdef MSG_NOSIGNAL
+        #define S_MSG_NOSIGNAL        MSG_NOSIGNAL
+    #else
+        #define S_MSG_NOSIGNAL        0
+    #endif
     #define S_EWOULDBLOCK             EWOULDBLOCK
     #define S_EINPROGRESS             EINPROGRESS
     #define S_EALREADY                EALREADY
@@ -71,6 +81,9 @@
     #define close closesocket
     #define ioctl ioctlsocket
     #define poll WSAPoll
+    #define S_SHUT_RDWR               SD_BOTH
+    #define S_SHUT_WR                 SD_SEND
+    #define S_MSG_NOSIGNAL            0
     #define S_EWOULDBLOCK             WSAEWOULDBLOCK
     #define S_EINPROGRESS             WSAEINPROGRESS
     #define S_EALREADY                WSAEALREADY
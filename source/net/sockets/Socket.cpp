@@ -15,10 +15,15 @@
 #include <memory>
 #include <net/sockets/Socket.h>
 #include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketController.h>
 #include <net/sockets/SocketConnectAwaiter.h>
 #include <net/sockets/SocketSendAwaiter.h>
 #include <net/sockets/SocketRecvAwaiter.h>
 #include <net/sockets/SocketAcceptAwaiter.h>
+#include <net/sockets/SocketAcceptBatchAwaiter.h>
+#include <net/sockets/SocketSendFileAwaiter.h>
+#include <net/sockets/SocketSendvAwaiter.h>
+#include <net/sockets/SocketRecvUntilAwaiter.h>
 
 using namespace std;
 using namespace chrono;
@@ -121,10 +126,15 @@ Socket::Socket(int handle) {
     SetBlocking(true);
 }
 
+Socket::Socket(int handle, bool blocking) {
+    InitializeSystem();
+    _handle = handle;
+    _blocking = blocking;
+}
+
 Socket::~Socket()
 {
-    if(_handle != InvalidSocket)
-        close(_handle);
+    Close();
 
     ShutdownSystem();
 }
@@ -171,10 +181,22 @@ void Socket::SetBlocking(bool value)
 
 void Socket::SetTcpNoDelay(bool value)
 {
-    int noDelay = value ? 0 : 1;
+    int noDelay = value ? 1 : 0;
     int ret = setsockopt(_handle, IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, sizeof(int));
 }
 
+void Socket::SetReusePort(bool value)
+{
+#ifdef SO_REUSEPORT
+    int reuse = value ? 1 : 0;
+    if(setsockopt(_handle, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(int)) == SocketError)
+        throw runtime_error("failed to set socket option: reuse port");
+#else
+    if(value)
+        throw runtime_error("socket option not supported: reuse port");
+#endif
+}
+
 void Socket::Bind(int port, const char* address, bool reuseAddress)
 {
     sockaddr_in addr{};
@@ -203,6 +225,18 @@ void Socket::Listen()
         throw runtime_error("failed to listen");
 }
 
+void Socket::Shutdown()
+{
+    if(_handle != InvalidSocket)
+        shutdown(_handle, S_SHUT_RDWR);
+}
+
+void Socket::ShutdownSend()
+{
+    if(_handle != InvalidSocket)
+        shutdown(_handle, S_SHUT_WR);
+}
+
 void Socket::Connect(int port, const char* address)
 {
     sockaddr_in addr;
@@ -224,7 +258,13 @@ Socket Socket::Accept()
 
     int ret = (int)accept((SOCKET)_handle, (sockaddr*)&addr, &len);
     if(ret == InvalidSocket)
-        throw runtime_error("failed to accept connection");
+    {
+        int code = errno;
+        if(!_blocking && code == S_EWOULDBLOCK)
+            return Socket();
+        else
+            throw runtime_error("failed to accept connection");
+    }
 
     return Socket(ret);
 }
@@ -232,6 +272,10 @@ Socket Socket::Accept()
 void Socket::Close()
 {
     if(_handle != InvalidSocket) {
+        // only non-blocking sockets can have async operations pending
+        if(!_blocking)
+            SocketController::instance.Release(_handle);
+
         close(_handle);
         _handle = InvalidSocket;
     }
@@ -264,7 +308,7 @@ int Socket::Send(const char *buffer, size_t length)
     if(_handle == InvalidSocket)
         throw runtime_error("invalid socket");
     
-    int ret = send(_handle, buffer, (int)length, 0);
+    int ret = send(_handle, buffer, (int)length, S_MSG_NOSIGNAL);
     if(ret == SocketError)
     {
         int code = errno;
@@ -324,25 +368,55 @@ int Socket::Poll(SocketPollMode mode, milliseconds timeout)
 Task<void> Socket::ConnectAsync(int port, const std::string& address)
 {
     ThrowIfBlocking();
-    return Task<void>(std::make_shared<SocketConnectAwaiter>(_handle, port, address));
+    return Task<void>(MakePooled<SocketConnectAwaiter>(_handle, port, address));
 }
 
 Task<Socket> Socket::AcceptAsync()
 {
     ThrowIfBlocking();
-    return Task<Socket>(std::make_shared<SocketAcceptAwaiter>(_handle));
+    return Task<Socket>(MakePooled<SocketAcceptAwaiter>(_handle));
+}
+
+Task<int> Socket::AcceptAsync(Socket* sockets, int maxCount)
+{
+    ThrowIfBlocking();
+    return Task<int>(MakePooled<SocketAcceptBatchAwaiter>(_handle, sockets, maxCount));
 }
 
 Task<int> Socket::SendAsync(const char* bufferPtr, size_t bufferSize)
 {
     ThrowIfBlocking();
-    return Task<int>(std::make_shared<SocketSendAwaiter>(_handle, bufferPtr, bufferSize));
+    return Task<int>(MakePooled<SocketSendAwaiter>(_handle, bufferPtr, bufferSize));
+}
+
+Task<int> Socket::SendAllAsync(const char* bufferPtr, size_t bufferSize)
+{
+    ThrowIfBlocking();
+    return Task<int>(MakePooled<SocketSendvAwaiter>(_handle, bufferPtr, bufferSize));
+}
+
+Task<int> Socket::SendvAsync(SocketBuffer* buffers, int count)
+{
+    ThrowIfBlocking();
+    return Task<int>(MakePooled<SocketSendvAwaiter>(_handle, buffers, count));
+}
+
+Task<int> Socket::SendFileAsync(int file, int64_t offset, size_t size)
+{
+    ThrowIfBlocking();
+    return Task<int>(MakePooled<SocketSendFileAwaiter>(_handle, file, offset, size));
 }
 
 Task<int> Socket::RecvAsync(char* bufferPtr, size_t bufferSize)
 {
     ThrowIfBlocking();
-    return Task<int>(std::make_shared<SocketRecvAwaiter>(_handle, bufferPtr, bufferSize));
+    return Task<int>(MakePooled<SocketRecvAwaiter>(_handle, bufferPtr, bufferSize));
+}
+
+Task<int> Socket::RecvUntilAsync(char* bufferPtr, size_t bufferSize, const char* delimiter)
+{
+    ThrowIfBlocking();
+    return Task<int>(MakePooled<SocketRecvUntilAwaiter>(_handle, bufferPtr, bufferSize, delimiter));
 }
 
 string Socket::GetHostIP(const string& host)
@@ -78,6 +78,25 @@ enum class SocketPollMode
     Connect = Write
 };
 
+// one buffer of a vectored send. Laid out like iovec (WSABUF on Windows),
+// so an array of them can be handed to the OS as-is.
+struct SocketBuffer
+{
+#ifdef _WIN32
+    unsigned long size;
+    char* data;
+
+    SocketBuffer(const char* data = nullptr, size_t size = 0)
+        : size((unsigned long)size), data((char*)data) {}
+#else
+    char* data;
+    size_t size;
+
+    SocketBuffer(const char* data = nullptr, size_t size = 0)
+        : data((char*)data), size(size) {}
+#endif
+};
+
 class Socket
 {
 public:
@@ -98,6 +117,9 @@ public:
     Socket();
     Socket(AddressFamily family, SocketType type, ProtocolType protocol);
     Socket(int handle);
+
+    // takes ownership of 'handle', which is already in the given blocking mode
+    Socket(int handle, bool blocking);
     ~Socket();
 
     Socket(const Socket& sock) = delete;
@@ -112,12 +134,29 @@ public:
 
     void SetBlocking(bool value);
     void SetTcpNoDelay(bool value);
+
+    ///<summary>Lets several sockets bind the same port. On Linux, the kernel
+    ///spreads incoming connections across all listening sockets bound to it.</summary>
+    ///<exception cref="runtime_error">Thrown if the option can't be set</exception>
+    void SetReusePort(bool value);
+
     void Bind(int port, const char* address = nullptr, bool reuseAddress = false);
     void Listen();
+
+    ///<summary>Returns an invalid socket if this socket is set to
+    ///non-blocking mode and no connection is pending.</summary>
     Socket Accept();
     void Connect(int port, const char* address);
     void Close();
 
+    ///<summary>Disables sends and receives without closing the handle.
+    ///Pending async operations complete with 0 or an error.</summary>
+    void Shutdown();
+
+    ///<summary>Disables sends, so the peer receives end of stream once the data
+    ///already sent arrives. Receives still work.</summary>
+    void ShutdownSend();
+
     ///<summary>Returns the number of bytes received, or -1 if the socket
     ///is set to non-blocking mode and the operation would have blocked.</summary>
     ///<exception cref="SocketException">Thrown for all errors except EWOULDBLOCK</exception>
@@ -145,20 +184,51 @@ public:
     // throws socket_error on failure
     Task<void> ConnectAsync(int port, const std::string& address);
     
-    // returns the newly connected socket
+    // returns the newly connected socket, in non-blocking mode
     // throws socket_error on failure
     Task<Socket> AcceptAsync();
+
+    // accepts up to 'maxCount' pending connections into 'sockets', waiting for the first one
+    // if there are none. Returns the number accepted. The sockets are in non-blocking mode.
+    // throws socket_error on failure
+    // sockets must live until call completes
+    Task<int> AcceptAsync(Socket* sockets, int maxCount);
     
     // returns the buffer argument for reuse
     // throws socket_error on failure
     // buffer must live until call completes
     Task<int> SendAsync(const char* bufferPtr, size_t bufferSize);
 
+    // sends every byte of the buffer, resuming the caller only once it's all sent.
+    // Returns the number of bytes sent.
+    // throws socket_error on failure
+    // buffer must live until call completes
+    Task<int> SendAllAsync(const char* bufferPtr, size_t bufferSize);
+
+    // sends every byte of 'buffers' with as few system calls as possible, continuing
+    // after partial writes. Returns the total number of bytes sent.
+    // throws socket_error on failure
+    // 'buffers' is advanced past the data that was sent, and it and the data must live until call completes
+    Task<int> SendvAsync(SocketBuffer* buffers, int count);
+
+    // sends up to 'size' bytes of 'file' (an OS file handle) starting at 'offset', without
+    // copying them through user space. Returns the number of bytes sent.
+    // throws socket_error on failure, with EINVAL or ENOSYS if the file can't be sent this way
+    // (see SOCKET_SENDFILE_SUPPORTED)
+    Task<int> SendFileAsync(int file, int64_t offset, size_t size);
+
     // returns the buffer argument containing received data
     // throws socket_error on failure
     // buffer must live until call completes
     Task<int> RecvAsync(char* bufferPtr, size_t bufferSize);
 
+    // receives until 'delimiter' has been received, the buffer is full, or the peer closes
+    // the connection, resuming the caller only once. Returns the number of bytes received,
+    // which may include data past the delimiter, or 0 if the connection closed first.
+    // throws socket_error on failure
+    // buffer and delimiter must live until call completes
+    Task<int> RecvUntilAsync(char* bufferPtr, size_t bufferSize, const char* delimiter);
+
     static std::string GetHostIP(const std::string& host);
 
 private:
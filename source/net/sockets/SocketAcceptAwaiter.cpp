@@ -32,7 +32,7 @@ void SocketAcceptAwaiter::suspend(std::experimental::coroutine_handle<> handle)
     this->handle = handle;
 
     SocketController::instance.Accept(
-        socket, this,
+        socket, &clientSocket, 1, this,
         [](int result, int error, void* context) {
             auto awaiter = (SocketAcceptAwaiter*)context;
             awaiter->result = result;
@@ -46,5 +46,5 @@ Socket SocketAcceptAwaiter::resume()
     if (result == -1)
         throw socket_error("accept operation failed", error);
     
-    return Socket(result);
+    return Socket(clientSocket, false);
 }
@@ -23,6 +23,7 @@ class SocketAcceptAwaiter : public Awaiter<Socket>
     int socket = -1;
     int result = 0;
     int error = 0;
+    int clientSocket = -1;
 
 public:
     SocketAcceptAwaiter(int socket);
@@ -0,0 +1,53 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <net/sockets/SocketAcceptBatchAwaiter.h>
+#include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketController.h>
+#include <net/sockets/socket_error.h>
+
+using namespace std;
+
+SocketAcceptBatchAwaiter::SocketAcceptBatchAwaiter(int socket, Socket* sockets, int maxCount)
+    : socket(socket), sockets(sockets), maxCount(std::clamp(maxCount, 1, MaxCount))
+{
+    
+}
+
+SocketAcceptBatchAwaiter::~SocketAcceptBatchAwaiter()
+{
+    
+}
+
+bool SocketAcceptBatchAwaiter::ready()
+{
+    return false;
+}
+
+void SocketAcceptBatchAwaiter::suspend(std::experimental::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    SocketController::instance.Accept(
+        socket, clientSockets, maxCount, this,
+        [](int result, int error, void* context) {
+            auto awaiter = (SocketAcceptBatchAwaiter*)context;
+            awaiter->result = result;
+            awaiter->error = error;
+            awaiter->handle.resume();
+        });
+}
+
+int SocketAcceptBatchAwaiter::resume()
+{
+    if (result == -1)
+        throw socket_error("accept operation failed", error);
+
+    for (int i = 0; i < result; ++i)
+        sockets[i] = Socket(clientSockets[i], false);
+
+    return result;
+}
@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstdint>
+#include <experimental/coroutine>
+#include <system/Dispatcher.h>
+#include <system/Task.h>
+#include <system/Awaiter.h>
+#include <net/sockets/Socket.h>
+
+class SocketAcceptBatchAwaiter : public Awaiter<int>
+{
+public:
+    static constexpr int MaxCount = 64;
+
+private:
+    std::experimental::coroutine_handle<> handle;
+    int socket = -1;
+    Socket* sockets = nullptr;
+    int maxCount = 0;
+    int result = 0;
+    int error = 0;
+    int clientSockets[MaxCount];
+
+public:
+    // 'maxCount' is limited to MaxCount
+    SocketAcceptBatchAwaiter(int socket, Socket* sockets, int maxCount);
+    ~SocketAcceptBatchAwaiter();
+
+    SocketAcceptBatchAwaiter(const SocketAcceptBatchAwaiter&) = delete;
+    SocketAcceptBatchAwaiter& operator=(const SocketAcceptBatchAwaiter&) = delete;
+
+    virtual bool ready();
+    virtual void suspend(std::experimental::coroutine_handle<> handle);
+    virtual int resume();
+};
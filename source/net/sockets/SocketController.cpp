@@ -6,18 +6,184 @@
 #include <net/sockets/Socket.h>
 #include <net/sockets/SocketController.h>
 #include <net/sockets/OSSockets.h>
+#include <system/Console.h>
+#include <system/MemoryPool.h>
 #include <mutex>
 #include <thread>
 #include <algorithm>
+#include <csignal>
+#include <cstddef>
+#include <climits>
+#include <cstring>
+#include <string_view>
+
+#if defined(__linux__)
+    #include <sys/sendfile.h>
+#elif defined(__APPLE__)
+    #include <sys/uio.h>
+#endif
 
 SocketController SocketController::instance;
 
+namespace
+{
+    // the calling thread's waiter, or null if it doesn't have one
+    thread_local SocketWaiter* currentWaiter = nullptr;
+
+    // the owner of a socket that has waited in more than one waiter
+    SocketWaiter* const SharedOwner = reinterpret_cast<SocketWaiter*>(uintptr_t(1));
+}
+
 SocketController::SocketController()
 {
+#ifndef _WIN32
+    // sendfile() has no MSG_NOSIGNAL, so a peer reset would raise SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
 }
 
 SocketController::~SocketController()
 {
+    for (auto& block : ownerBlocks)
+        delete[] block.load();
+}
+
+void SocketController::SetEngine(SocketEngine engine)
+{
+    if (engine == SocketEngine::Completion && !SocketRing::IsSupported())
+    {
+        Console::WriteLine("io_uring is not available, using readiness based socket operations");
+        engine = SocketEngine::Readiness;
+    }
+
+    this->engine = engine;
+}
+
+SocketEngine SocketController::GetEngine() const {
+    return engine;
+}
+
+SocketWaiter& SocketController::GetWaiter()
+{
+    struct WaiterHolder
+    {
+        std::unique_ptr<SocketWaiter> waiter;
+
+        ~WaiterHolder() {
+            if (waiter) {
+                SocketController::instance.RemoveWaiter(waiter.get());
+                currentWaiter = nullptr;
+            }
+        }
+    };
+
+    // the dispatcher must outlive the waiter attached to it,
+    // so make sure it's constructed (and destroyed) first
+    Dispatcher::current();
+
+    static thread_local WaiterHolder holder;
+    
+    if (!holder.waiter)
+    {
+        holder.waiter = std::make_unique<SocketWaiter>();
+        AddWaiter(holder.waiter.get());
+        currentWaiter = holder.waiter.get();
+    }
+
+    return *holder.waiter;
+}
+
+void SocketController::AddWaiter(SocketWaiter* waiter)
+{
+    std::lock_guard<std::mutex> lk(waitersMutex);
+    waiters.push_back(waiter);
+}
+
+void SocketController::RemoveWaiter(SocketWaiter* waiter)
+{
+    std::lock_guard<std::mutex> lk(waitersMutex);
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), waiter), waiters.end());
+
+    // only the waiter's own thread records it as an owner, and that thread is exiting
+    for (auto& block : ownerBlocks)
+    {
+        if (auto owners = block.load())
+        {
+            for (size_t i = 0; i < OwnerBlockSize; ++i)
+            {
+                SocketWaiter* expected = waiter;
+                owners[i].compare_exchange_strong(expected, nullptr);
+            }
+        }
+    }
+}
+
+void SocketController::Wait(SocketOperationType type, SocketOperation* op, void(*callback)(void* operation, intmax_t result))
+{
+    auto& waiter = GetWaiter();
+    RecordOwner(op->socket, waiter);
+    waiter.Wait(type, op->socket, op, callback, op->dispatcher);
+}
+
+SocketRing* SocketController::UseRing(int socket)
+{
+    if (engine != SocketEngine::Completion)
+        return nullptr;
+
+    auto& waiter = GetWaiter();
+
+    auto ring = waiter.OpenRing(&SocketController::CompleteRingOperation);
+    if (ring)
+        RecordOwner(socket, waiter);
+
+    return ring;
+}
+
+void SocketController::RecordOwner(int socket, SocketWaiter& waiter)
+{
+    if (auto owner = FindOwner(socket, true))
+    {
+        SocketWaiter* current = owner->load(std::memory_order_relaxed);
+
+        while (current != &waiter && current != SharedOwner &&
+               !owner->compare_exchange_weak(current, current ? SharedOwner : &waiter))
+        {
+        }
+    }
+}
+
+std::atomic<SocketWaiter*>* SocketController::FindOwner(int socket, bool create)
+{
+    if (socket < 0 || (size_t)socket >= OwnerBlockSize * MaxOwnerBlocks)
+        return nullptr;
+
+    auto& block = ownerBlocks[socket / OwnerBlockSize];
+    auto owners = block.load(std::memory_order_acquire);
+
+    if (!owners && create)
+    {
+        auto allocated = new std::atomic<SocketWaiter*>[OwnerBlockSize]();
+
+        if (block.compare_exchange_strong(owners, allocated, std::memory_order_acq_rel))
+            owners = allocated;
+        else
+            delete[] allocated;
+    }
+
+    return owners ? &owners[socket % OwnerBlockSize] : nullptr;
+}
+
+void SocketController::RemoveFromAll(int socket)
+{
+    std::lock_guard<std::mutex> lk(waitersMutex);
+    for (auto waiter : waiters)
+        RemoveFrom(waiter, socket);
+}
+
+void SocketController::RemoveFrom(SocketWaiter* waiter, int socket)
+{
+    waiter->Remove(socket);
+    waiter->ring.Cancel(socket);
 }
 
 void SocketController::Connect(
@@ -28,20 +194,25 @@ void SocketController::Connect(
     SocketCallback callback
 )
 {
-    auto op = new SocketOperation{ &Dispatcher::current(), socket, nullptr, 0, context, 0, callback };
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, nullptr, 0, context, 0, callback });
 
-    sockaddr_in addr;
+    sockaddr_in& addr = op->address;
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
 
+    if (auto ring = UseRing(socket)) {
+        ring->Connect(socket, (sockaddr*)&addr, sizeof(sockaddr_in), op);
+        return;
+    }
+
     int ret = connect((Socket::HandleType)socket, (sockaddr*)&addr, sizeof(sockaddr_in));
     if (ret == Socket::SocketError)
     {
         int err = errno;
         if (err == S_EWOULDBLOCK)
         {
-            socketWaiter.Wait(SocketOperationType::Connect, socket, op, &SocketController::ContinueConnect, op->dispatcher);
+            Wait(SocketOperationType::Connect, op, &SocketController::ContinueConnect);
         }
         else
         {
@@ -57,33 +228,61 @@ void SocketController::Connect(
 
 void SocketController::Accept(
     int socket,
+    int* sockets,
+    int maxCount,
     void* context,
     SocketCallback callback
 )
 {
-    auto op = new SocketOperation{ &Dispatcher::current(), socket, nullptr, 0, context, 0, callback };
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, (char*)sockets, (size_t)maxCount, context, 0, callback });
 
-    sockaddr_in addr{};
-    socklen_t len = sizeof(addr);
+    if (auto ring = UseRing(socket)) {
+        ring->Accept(socket, sockets, maxCount, op);
+        return;
+    }
+
+    int count = AcceptPending(socket, sockets, maxCount, op->error);
+    if (count == 0)
+        Wait(SocketOperationType::Accept, op, &SocketController::ContinueAccept);
+    else
+        Dispatcher::current().InvokeAsync(&FinalizeAccept, op, count);
+}
+
+int SocketController::AcceptPending(int socket, int* sockets, int maxCount, int& error)
+{
+    int count = 0;
 
-    int clientSocket = (int)accept((Socket::HandleType)socket, (sockaddr*)&addr, &len);
-    if (clientSocket == Socket::InvalidSocket)
+    while (count < maxCount)
     {
-        int err = errno;
-        if (err == S_EWOULDBLOCK || err == EAGAIN)
-        {
-            socketWaiter.Wait(SocketOperationType::Accept, socket, op, &SocketController::ContinueAccept, op->dispatcher);
-        }
-        else
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+
+#ifdef __linux__
+        int clientSocket = accept4(socket, (sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int clientSocket = (int)accept((Socket::HandleType)socket, (sockaddr*)&addr, &len);
+#endif
+        if (clientSocket == Socket::InvalidSocket)
         {
-            op->error = err;
-            Dispatcher::current().InvokeAsync(&FinalizeAccept, op, -1);
+            int err = errno;
+            if (count == 0 && err != S_EWOULDBLOCK && err != EAGAIN) {
+                error = err;
+                return -1;
+            }
+
+            // report other errors on the next call, with these sockets delivered
+            break;
         }
+
+#ifndef __linux__
+        unsigned long nonBlockingMode = 1;
+        ioctl((Socket::HandleType)clientSocket, FIONBIO, &nonBlockingMode);
+#endif
+
+        sockets[count++] = clientSocket;
     }
-    else
-    {
-        Dispatcher::current().InvokeAsync(&FinalizeAccept, op, clientSocket);
-    }
+
+    return count;
 }
 
 void SocketController::Send(
@@ -91,18 +290,29 @@ void SocketController::Send(
     const char* bufferPtr,
     size_t bufferSize,
     void* context,
-    SocketCallback callback
+    SocketCallback callback,
+    bool tryFirst
 )
 {
-    auto op = new SocketOperation{ &Dispatcher::current(), socket, (char*)bufferPtr, bufferSize, context, 0, callback };
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, (char*)bufferPtr, bufferSize, context, 0, callback });
     
-    int sent = send((Socket::HandleType)socket, bufferPtr, (int)bufferSize, 0);
+    if (auto ring = UseRing(socket)) {
+        ring->Send(socket, bufferPtr, bufferSize, op);
+        return;
+    }
+
+    if (!tryFirst) {
+        Wait(SocketOperationType::Send, op, &SocketController::ContinueSend);
+        return;
+    }
+
+    int sent = send((Socket::HandleType)socket, bufferPtr, (int)bufferSize, S_MSG_NOSIGNAL);
     if (sent == Socket::SocketError)
     {
         int err = errno;
         if (err == S_EWOULDBLOCK)
         {
-            socketWaiter.Wait(SocketOperationType::Send, socket, op, &SocketController::ContinueSend, op->dispatcher);
+            Wait(SocketOperationType::Send, op, &SocketController::ContinueSend);
         }
         else
         {
@@ -121,10 +331,21 @@ void SocketController::Receive(
     char* bufferPtr,
     size_t bufferSize,
     void* context,
-    SocketCallback callback
+    SocketCallback callback,
+    bool tryFirst
 )
 {
-    auto op = new SocketOperation{ &Dispatcher::current(), socket, bufferPtr, bufferSize, context, 0, callback };
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, bufferPtr, bufferSize, context, 0, callback });
+
+    if (auto ring = UseRing(socket)) {
+        ring->Receive(socket, bufferPtr, bufferSize, op);
+        return;
+    }
+
+    if (!tryFirst) {
+        Wait(SocketOperationType::Recv, op, &SocketController::ContinueRecv);
+        return;
+    }
 
     int received = recv((Socket::HandleType)socket, bufferPtr, (int)bufferSize, 0);
     if (received == Socket::SocketError)
@@ -132,7 +353,7 @@ void SocketController::Receive(
         int err = errno;
         if (err == S_EWOULDBLOCK)
         {
-            socketWaiter.Wait(SocketOperationType::Recv, socket, op, &SocketController::ContinueRecv, op->dispatcher);
+            Wait(SocketOperationType::Recv, op, &SocketController::ContinueRecv);
         }
         else
         {
@@ -147,16 +368,391 @@ void SocketController::Receive(
     }
 }
 
+SocketResult SocketController::TrySend(int socket, const char* bufferPtr, size_t bufferSize, int& result, int& error)
+{
+    if (engine == SocketEngine::Completion || !TakeSyncBudget())
+        return SocketResult::Deferred;
+
+    result = send((Socket::HandleType)socket, bufferPtr, (int)bufferSize, S_MSG_NOSIGNAL);
+    if (result != Socket::SocketError)
+        return SocketResult::Completed;
+
+    error = errno;
+    return error == S_EWOULDBLOCK ? SocketResult::Blocked : SocketResult::Failed;
+}
+
+SocketResult SocketController::TryReceive(int socket, char* bufferPtr, size_t bufferSize, int& result, int& error)
+{
+    if (engine == SocketEngine::Completion || !TakeSyncBudget())
+        return SocketResult::Deferred;
+
+    result = recv((Socket::HandleType)socket, bufferPtr, (int)bufferSize, 0);
+    if (result != Socket::SocketError)
+        return SocketResult::Completed;
+
+    error = errno;
+    return error == S_EWOULDBLOCK ? SocketResult::Blocked : SocketResult::Failed;
+}
+
+void SocketController::Sendv(
+    int socket,
+    SocketBuffer* buffers,
+    int count,
+    void* context,
+    SocketCallback callback,
+    bool tryFirst
+)
+{
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, (char*)buffers, (size_t)count, context, 0, callback });
+    op->composite = SocketComposite::Sendv;
+
+    if (auto ring = UseRing(socket))
+    {
+        AdvanceBuffers(buffers, count, 0);
+        op->bufferPtr = (char*)buffers;
+        op->bufferSize = count;
+
+        if (count == 0)
+            Dispatcher::current().InvokeAsync(&FinalizeSendv, op, 0);
+        else
+            ring->Sendv(socket, buffers, std::min(count, MaxSendBuffers), op);
+        
+        return;
+    }
+
+    if (!tryFirst || !SendvPending(op))
+        Wait(SocketOperationType::Send, op, &SocketController::ContinueSendv);
+    else
+        Dispatcher::current().InvokeAsync(&FinalizeSendv, op, (intmax_t)op->offset);
+}
+
+SocketResult SocketController::TrySendv(int socket, SocketBuffer*& buffers, int& count, int& result, int& error)
+{
+    if (engine == SocketEngine::Completion || !TakeSyncBudget())
+        return SocketResult::Deferred;
+
+    result = 0;
+    AdvanceBuffers(buffers, count, 0);
+
+    while (count > 0)
+    {
+        int sent = SendvPart(socket, buffers, count, error);
+        if (sent == -1)
+        {
+            if (error == S_EWOULDBLOCK)
+                return SocketResult::Blocked;
+
+            result = -1;
+            return SocketResult::Failed;
+        }
+
+        result += sent;
+    }
+
+    return SocketResult::Completed;
+}
+
+int SocketController::SendvPart(int socket, SocketBuffer*& buffers, int& count, int& error)
+{
+    int bufferCount = std::min(count, MaxSendBuffers);
+
+#ifdef _WIN32
+    DWORD sent = 0;
+    if (WSASend((SOCKET)socket, (WSABUF*)buffers, (DWORD)bufferCount, &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        error = errno;
+        return -1;
+    }
+#else
+    static_assert(sizeof(SocketBuffer) == sizeof(iovec) && offsetof(SocketBuffer, size) == offsetof(iovec, iov_len),
+        "SocketBuffer must have the same layout as iovec");
+
+    msghdr message{};
+    message.msg_iov = (iovec*)buffers;
+    message.msg_iovlen = bufferCount;
+
+    ssize_t sent = sendmsg(socket, &message, S_MSG_NOSIGNAL);
+    if (sent == -1) {
+        error = errno;
+        return -1;
+    }
+#endif
+
+    AdvanceBuffers(buffers, count, (size_t)sent);
+    return (int)sent;
+}
+
+void SocketController::AdvanceBuffers(SocketBuffer*& buffers, int& count, size_t sent)
+{
+    // skips empty buffers too, so 'count' is zero once everything is sent
+    while (count > 0 && sent >= buffers->size)
+    {
+        sent -= buffers->size;
+        ++buffers;
+        --count;
+    }
+
+    if (count > 0) {
+        buffers->data += sent;
+        buffers->size -= decltype(buffers->size)(sent);
+    }
+}
+
+bool SocketController::SendvPending(SocketOperation* op)
+{
+    auto buffers = (SocketBuffer*)op->bufferPtr;
+    int count = (int)op->bufferSize;
+    bool done = true;
+
+    AdvanceBuffers(buffers, count, 0);
+
+    while (count > 0)
+    {
+        int sent = SendvPart(op->socket, buffers, count, op->error);
+        if (sent == -1)
+        {
+            if (op->error == S_EWOULDBLOCK) {
+                op->error = 0;
+                done = false;
+            }
+            else {
+                op->offset = -1;
+            }
+            break;
+        }
+
+        op->offset += sent;
+    }
+
+    op->bufferPtr = (char*)buffers;
+    op->bufferSize = count;
+    return done;
+}
+
+void SocketController::ReceiveUntil(
+    int socket,
+    char* bufferPtr,
+    size_t size,
+    size_t received,
+    const char* delimiter,
+    void* context,
+    SocketCallback callback,
+    bool tryFirst
+)
+{
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, bufferPtr, size, context, 0, callback });
+    op->composite = SocketComposite::ReceiveUntil;
+    op->delimiter = delimiter;
+    op->delimiterSize = strlen(delimiter);
+    op->offset = (int64_t)received;
+
+    if (auto ring = UseRing(socket))
+    {
+        if (received == size)
+            Dispatcher::current().InvokeAsync(&FinalizeReceiveUntil, op, (intmax_t)received);
+        else
+            ring->Receive(socket, bufferPtr + received, size - received, op);
+        
+        return;
+    }
+
+    if (!tryFirst) {
+        Wait(SocketOperationType::Recv, op, &SocketController::ContinueReceiveUntil);
+        return;
+    }
+
+    SocketResult res = ReceiveUntilPending(socket, bufferPtr, size, received, delimiter, op->delimiterSize, op->error);
+    op->offset = (int64_t)received;
+
+    if (res == SocketResult::Blocked)
+        Wait(SocketOperationType::Recv, op, &SocketController::ContinueReceiveUntil);
+    else
+        Dispatcher::current().InvokeAsync(&FinalizeReceiveUntil, op, res == SocketResult::Failed ? -1 : (intmax_t)received);
+}
+
+SocketResult SocketController::TryReceiveUntil(int socket, char* bufferPtr, size_t size, size_t& received, const char* delimiter, int& error)
+{
+    if (engine == SocketEngine::Completion || !TakeSyncBudget())
+        return SocketResult::Deferred;
+
+    return ReceiveUntilPending(socket, bufferPtr, size, received, delimiter, strlen(delimiter), error);
+}
+
+SocketResult SocketController::ReceiveUntilPending(
+    int socket,
+    char* bufferPtr,
+    size_t size,
+    size_t& received,
+    const char* delimiter,
+    size_t delimiterSize,
+    int& error
+)
+{
+    while (received < size)
+    {
+        int count = recv((Socket::HandleType)socket, bufferPtr + received, (int)std::min(size - received, (size_t)INT_MAX), 0);
+        if (count == Socket::SocketError)
+        {
+            error = errno;
+            return error == S_EWOULDBLOCK ? SocketResult::Blocked : SocketResult::Failed;
+        }
+
+        size_t from = received;
+        received += count;
+
+        if (count == 0 || FindDelimiter(bufferPtr, from, received, delimiter, delimiterSize))
+            break;
+    }
+
+    return SocketResult::Completed;
+}
+
+bool SocketController::FindDelimiter(const char* bufferPtr, size_t from, size_t to, const char* delimiter, size_t delimiterSize)
+{
+    // the delimiter may have started in data that was already searched
+    from -= std::min(from, delimiterSize - 1);
+    return std::string_view(bufferPtr + from, to - from).find(std::string_view(delimiter, delimiterSize)) != std::string_view::npos;
+}
+
+void SocketController::SendFile(
+    int socket,
+    int file,
+    int64_t offset,
+    size_t size,
+    void* context,
+    SocketCallback callback,
+    bool tryFirst
+)
+{
+    auto op = MemoryPool::New<SocketOperation>(SocketOperation{ &Dispatcher::current(), socket, nullptr, size, context, 0, callback });
+    op->file = file;
+    op->offset = offset;
+
+    if (!tryFirst) {
+        Wait(SocketOperationType::Send, op, &SocketController::ContinueSendFile);
+        return;
+    }
+
+    int sent = SendFilePart(socket, file, offset, size, op->error);
+    if (sent == -1 && op->error == S_EWOULDBLOCK)
+        Wait(SocketOperationType::Send, op, &SocketController::ContinueSendFile);
+    else
+        Dispatcher::current().InvokeAsync(&FinalizeSendFile, op, sent);
+}
+
+SocketResult SocketController::TrySendFile(int socket, int file, int64_t offset, size_t size, int& result, int& error)
+{
+    // not deferred for the Completion engine, which can't send files anyway
+    if (!TakeSyncBudget())
+        return SocketResult::Deferred;
+
+    result = SendFilePart(socket, file, offset, size, error);
+    if (result != -1)
+        return SocketResult::Completed;
+
+    return error == S_EWOULDBLOCK ? SocketResult::Blocked : SocketResult::Failed;
+}
+
+int SocketController::SendFilePart(int socket, int file, int64_t offset, size_t size, int& error)
+{
+    // the result has to fit in an int
+    size = std::min(size, (size_t)1 << 30);
+
+#if defined(__linux__)
+    off_t off = (off_t)offset;
+    ssize_t sent = sendfile(socket, file, &off, size);
+    if (sent == -1) {
+        error = errno;
+        return -1;
+    }
+    return (int)sent;
+#elif defined(__APPLE__)
+    // a partial send fails with EAGAIN, but still reports what was sent in 'len'
+    off_t len = (off_t)size;
+    if (sendfile(file, socket, (off_t)offset, &len, nullptr, 0) == -1 && !(errno == EAGAIN && len > 0)) {
+        error = errno;
+        return -1;
+    }
+    return (int)len;
+#else
+    error = ENOSYS;
+    return -1;
+#endif
+}
+
+bool SocketController::TakeSyncBudget()
+{
+    struct SyncBudget
+    {
+        uint64_t invocation = 0;
+        int used = 0;
+    };
+
+    static thread_local SyncBudget budget;
+
+    // the budget is refilled each time the dispatcher moves on to another request
+    auto invocation = Dispatcher::current().GetInvocationCount();
+    if (budget.invocation != invocation) {
+        budget.invocation = invocation;
+        budget.used = 0;
+    }
+
+    return ++budget.used <= MaxSyncCompletions;
+}
+
+void SocketController::Release(int socket)
+{
+    auto owner = FindOwner(socket, false);
+
+    if (owner == nullptr)
+    {
+        // out of the table's range, so it could have waited anywhere
+        if (socket < 0 || (size_t)socket >= OwnerBlockSize * MaxOwnerBlocks)
+            RemoveFromAll(socket);
+    }
+    else if (auto waiter = owner->exchange(nullptr))
+    {
+        if (waiter == currentWaiter) {
+            // usually, the socket is closed on the thread that used it
+            RemoveFrom(waiter, socket);
+        }
+        else if (waiter == SharedOwner) {
+            RemoveFromAll(socket);
+        }
+        else {
+            // the owner's thread may be exiting, so make sure the waiter still exists
+            std::lock_guard<std::mutex> lk(waitersMutex);
+            if (std::find(waiters.begin(), waiters.end(), waiter) != waiters.end())
+                RemoveFrom(waiter, socket);
+        }
+    }
+}
+
+bool SocketController::FinalizeIfCancelled(void* operation, intmax_t result, void(*finalize)(void* operation, intmax_t result))
+{
+    if (result != -1)
+        return false;
+
+    ((SocketOperation*)operation)->error = ECANCELED;
+    Dispatcher::current().InvokeAsync(finalize, operation, -1);
+    return true;
+}
+
 void SocketController::ContinueConnect(void* operation, intmax_t result)
 {
+    if (FinalizeIfCancelled(operation, result, &FinalizeConnect))
+        return;
+
     auto op = (SocketOperation*)operation;
 
-    if (result == -1)
-    {
-        int error;
-        socklen_t sz = sizeof(error);
-        int ret = getsockopt((Socket::HandleType)op->socket, SOL_SOCKET, SO_ERROR, (char*)&error, &sz);
+    // the socket is writable once the connection either succeeds or fails
+    int error = 0;
+    socklen_t sz = sizeof(error);
+    if (getsockopt((Socket::HandleType)op->socket, SOL_SOCKET, SO_ERROR, (char*)&error, &sz) == -1)
+        error = errno;
+
+    if (error != 0) {
         op->error = error;
+        result = -1;
     }
 
     Dispatcher::current().InvokeAsync(&FinalizeConnect, op, result);
@@ -164,23 +760,30 @@ void SocketController::ContinueConnect(void* operation, intmax_t result)
 
 void SocketController::ContinueAccept(void* operation, intmax_t result)
 {
+    if (FinalizeIfCancelled(operation, result, &FinalizeAccept))
+        return;
+
     auto op = (SocketOperation*)operation;
 
-    sockaddr_in addr{};
-    socklen_t len = sizeof(addr);
-    int clientSocket = (int)accept((Socket::HandleType)op->socket, (sockaddr*)&addr, &len);
+    int count = AcceptPending(op->socket, (int*)op->bufferPtr, (int)op->bufferSize, op->error);
 
-    if (clientSocket == -1)
-        op->error = errno;
-    
-    Dispatcher::current().InvokeAsync(&FinalizeAccept, op, clientSocket);
+    // the connection went away before it was accepted, so keep waiting
+    if (count == 0) {
+        instance.Wait(SocketOperationType::Accept, op, &SocketController::ContinueAccept);
+        return;
+    }
+
+    Dispatcher::current().InvokeAsync(&FinalizeAccept, op, count);
 }
 
 void SocketController::ContinueSend(void* operation, intmax_t result)
 {
+    if (FinalizeIfCancelled(operation, result, &FinalizeSend))
+        return;
+
     auto op = (SocketOperation*)operation;
 
-    int sent = send((Socket::HandleType)op->socket, op->bufferPtr, (int)op->bufferSize, 0);
+    int sent = send((Socket::HandleType)op->socket, op->bufferPtr, (int)op->bufferSize, S_MSG_NOSIGNAL);
     if (sent == -1)
         op->error = errno;
 
@@ -189,6 +792,9 @@ void SocketController::ContinueSend(void* operation, intmax_t result)
 
 void SocketController::ContinueRecv(void* operation, intmax_t result)
 {
+    if (FinalizeIfCancelled(operation, result, &FinalizeReceive))
+        return;
+
     auto op = (SocketOperation*)operation;
 
     int received = recv((Socket::HandleType)op->socket, op->bufferPtr, (int)op->bufferSize, 0);
@@ -198,26 +804,162 @@ void SocketController::ContinueRecv(void* operation, intmax_t result)
     Dispatcher::current().InvokeAsync(&FinalizeReceive, op, received);
 }
 
+void SocketController::ContinueSendv(void* operation, intmax_t result)
+{
+    if (FinalizeIfCancelled(operation, result, &FinalizeSendv))
+        return;
+
+    auto op = (SocketOperation*)operation;
+
+    if (!SendvPending(op)) {
+        instance.Wait(SocketOperationType::Send, op, &SocketController::ContinueSendv);
+        return;
+    }
+
+    Dispatcher::current().InvokeAsync(&FinalizeSendv, op, (intmax_t)op->offset);
+}
+
+void SocketController::ContinueReceiveUntil(void* operation, intmax_t result)
+{
+    if (FinalizeIfCancelled(operation, result, &FinalizeReceiveUntil))
+        return;
+
+    auto op = (SocketOperation*)operation;
+
+    size_t received = (size_t)op->offset;
+    SocketResult res = ReceiveUntilPending(op->socket, op->bufferPtr, op->bufferSize, received, op->delimiter, op->delimiterSize, op->error);
+    op->offset = (int64_t)received;
+
+    if (res == SocketResult::Blocked) {
+        op->error = 0;
+        instance.Wait(SocketOperationType::Recv, op, &SocketController::ContinueReceiveUntil);
+        return;
+    }
+
+    Dispatcher::current().InvokeAsync(&FinalizeReceiveUntil, op, res == SocketResult::Failed ? -1 : (intmax_t)received);
+}
+
+void SocketController::ContinueSendFile(void* operation, intmax_t result)
+{
+    if (FinalizeIfCancelled(operation, result, &FinalizeSendFile))
+        return;
+
+    auto op = (SocketOperation*)operation;
+
+    int sent = SendFilePart(op->socket, op->file, op->offset, op->bufferSize, op->error);
+    Dispatcher::current().InvokeAsync(&FinalizeSendFile, op, sent);
+}
+
 void SocketController::FinalizeConnect(void* operation, intmax_t result)
 {
-    auto op = std::unique_ptr<SocketOperation>((SocketOperation*)operation);
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
     op->callback((int)result, op->error, op->context);
 }
 
 void SocketController::FinalizeAccept(void* operation, intmax_t result)
 {
-    auto op = std::unique_ptr<SocketOperation>((SocketOperation*)operation);
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
     op->callback((int)result, op->error, op->context);
 }
 
 void SocketController::FinalizeSend(void* operation, intmax_t result)
 {
-    auto op = std::unique_ptr<SocketOperation>((SocketOperation*)operation);
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
     op->callback((int)result, op->error, op->context);
 }
 
 void SocketController::FinalizeReceive(void* operation, intmax_t result)
 {
-    auto op = std::unique_ptr<SocketOperation>((SocketOperation*)operation);
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
+    op->callback((int)result, op->error, op->context);
+}
+
+void SocketController::FinalizeSendFile(void* operation, intmax_t result)
+{
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
     op->callback((int)result, op->error, op->context);
 }
+
+void SocketController::FinalizeSendv(void* operation, intmax_t result)
+{
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
+    op->callback((int)result, op->error, op->context);
+}
+
+void SocketController::FinalizeReceiveUntil(void* operation, intmax_t result)
+{
+    auto op = MemoryPool::Ptr<SocketOperation>((SocketOperation*)operation);
+    op->callback((int)result, op->error, op->context);
+}
+
+// called on the io_uring completion thread
+void SocketController::CompleteRingOperation(void* operation, int result, int error)
+{
+    auto op = (SocketOperation*)operation;
+    op->error = error;
+    op->dispatcher->InvokeAsync(&FinalizeRingOperation, op, result);
+}
+
+void SocketController::FinalizeRingOperation(void* operation, intmax_t result)
+{
+    auto pending = (SocketOperation*)operation;
+
+    // composite operations are resubmitted until they're done
+    if (pending->composite == SocketComposite::Sendv && !instance.CompleteRingSendv(pending, result))
+        return;
+
+    if (pending->composite == SocketComposite::ReceiveUntil && !instance.CompleteRingReceiveUntil(pending, result))
+        return;
+
+    auto op = MemoryPool::Ptr<SocketOperation>(pending);
+    op->callback((int)result, op->error, op->context);
+}
+
+bool SocketController::CompleteRingSendv(SocketOperation* op, intmax_t& result)
+{
+    if (result == -1)
+        return true;
+
+    auto buffers = (SocketBuffer*)op->bufferPtr;
+    int count = (int)op->bufferSize;
+        
+    AdvanceBuffers(buffers, count, (size_t)result);
+    op->offset += result;
+
+    if (count != 0 && result != 0)
+    {
+        op->bufferPtr = (char*)buffers;
+        op->bufferSize = count;
+        GetWaiter().ring.Sendv(op->socket, buffers, std::min(count, MaxSendBuffers), op);
+        return false;
+    }
+
+    if (count != 0) {
+        result = -1;
+        op->error = EPIPE;
+    }
+    else {
+        result = (intmax_t)op->offset;
+    }
+
+    return true;
+}
+
+bool SocketController::CompleteRingReceiveUntil(SocketOperation* op, intmax_t& result)
+{
+    if (result == -1)
+        return true;
+
+    size_t from = (size_t)op->offset;
+    size_t to = from + (size_t)result;
+    op->offset = to;
+
+    if (result != 0 && to < op->bufferSize && !FindDelimiter(op->bufferPtr, from, to, op->delimiter, op->delimiterSize))
+    {
+        GetWaiter().ring.Receive(op->socket, op->bufferPtr + to, op->bufferSize - to, op);
+        return false;
+    }
+
+    result = (intmax_t)to;
+    return true;
+}
@@ -12,22 +12,49 @@
 #include <net/sockets/Socket.h>
 #include <net/sockets/OSSockets.h>
 #include <net/sockets/SocketWaiter.h>
+#include <net/sockets/SocketRing.h>
 #include <experimental/coroutine>
 #include <functional>
 #include <memory>
 
+#if defined(__linux__) || defined(__APPLE__)
+    #define SOCKET_SENDFILE_SUPPORTED 1
+#else
+    #define SOCKET_SENDFILE_SUPPORTED 0
+#endif
+
+enum class SocketEngine
+{
+    // try each operation immediately, then wait for readiness in
+    // the SocketWaiter owned by the calling thread's dispatcher
+    Readiness,
+
+    // submit each operation to the io_uring ring owned by the calling thread's dispatcher,
+    // which reaps its completions inline. Falls back to Readiness if io_uring is not available.
+    Completion
+};
+
 enum class SocketResult
 {
     Completed,
     Blocked,
     Failed,
-    HungUp
+    HungUp,
+    Deferred
 };
 
 // result: 0 for success, -1 for error.
 // error: the errno/WSAGetLastError if result is -1
 typedef void(*SocketCallback)(int result, int error, void* context);
 
+// operations that SocketController keeps going until they're done
+enum class SocketComposite
+{
+    None,
+    Sendv,
+    ReceiveUntil
+};
+
 struct SocketOperation
 {
     Dispatcher* dispatcher = nullptr;
@@ -37,30 +64,176 @@ struct SocketOperation
     void* context = nullptr;
     int error = 0;
     SocketCallback callback = nullptr;
+    sockaddr_in address{};
+    int file = -1;          // SendFile() only
+    int64_t offset = 0;
+    SocketComposite composite = SocketComposite::None;
+    const char* delimiter = nullptr; // ReceiveUntil() only
+    size_t delimiterSize = 0;
 };
 
+// Accept() reuses SocketOperation::bufferPtr for its array of
+// accepted sockets, and SocketOperation::bufferSize for its length
+
+// Sendv() reuses SocketOperation::bufferPtr and bufferSize for its array of
+// buffers and their count, and SocketOperation::offset for the bytes sent so far
+
+// ReceiveUntil() reuses SocketOperation::offset for the bytes received so far
+
 class SocketController
 {
+    // synchronous completions allowed per dispatcher request before
+    // TrySend()/TryReceive() make the caller go through the dispatcher
+    static constexpr int MaxSyncCompletions = 16;
+
+    // buffers passed to each sendmsg() call, well under IOV_MAX
+    static constexpr int MaxSendBuffers = 64;
+
 public:
     SocketController();
     ~SocketController();
+
+    // only affects operations started after the call
+    void SetEngine(SocketEngine engine);
+    SocketEngine GetEngine() const;
     
     void Connect(int socket, const std::string& ip, int port, void* context, SocketCallback callback);
-    void Accept(int socket, void* context, SocketCallback callback);
-    void Send(int socket, const char* bufferPtr, size_t size, void* context, SocketCallback callback);
-    void Receive(int socket, char* bufferPtr, size_t size, void* context, SocketCallback callback);
+
+    // Accepts up to 'maxCount' pending connections into 'sockets', waiting for the first one if
+    // there are none. The callback's result is the number accepted, or -1. Accepted sockets are
+    // non-blocking and close-on-exec, and inherit TCP_NODELAY from 'socket' on Linux.
+    // 'sockets' must live until the callback is invoked.
+    void Accept(int socket, int* sockets, int maxCount, void* context, SocketCallback callback);
+
+    void Send(int socket, const char* bufferPtr, size_t size, void* context, SocketCallback callback, bool tryFirst = true);
+    void Receive(int socket, char* bufferPtr, size_t size, void* context, SocketCallback callback, bool tryFirst = true);
+
+    // Attempts the operation on the calling thread without allocating or posting to the dispatcher.
+    // Completed: 'result' holds the byte count. Failed: 'error' holds the errno.
+    // Blocked: the socket wasn't ready, so call Send()/Receive() with tryFirst = false.
+    // Deferred: the operation wasn't attempted (the Completion engine is in use, or the dispatcher's
+    //         budget of synchronous completions is used up), so call Send()/Receive() normally.
+    SocketResult TrySend(int socket, const char* bufferPtr, size_t size, int& result, int& error);
+    SocketResult TryReceive(int socket, char* bufferPtr, size_t size, int& result, int& error);
+
+    // Sends every byte of 'buffers' with sendmsg()/writev(), continuing after partial writes.
+    // The callback's result is the total number of bytes sent. 'buffers' is advanced past the data
+    // that was sent, and must live until the callback is invoked.
+    void Sendv(int socket, SocketBuffer* buffers, int count, void* context, SocketCallback callback, bool tryFirst = true);
+
+    // Like TrySend(), but Blocked may also mean part of the data was sent: 'result' holds the byte count,
+    // and 'buffers' and 'count' are advanced past it, ready to be passed to Sendv() with tryFirst = false.
+    SocketResult TrySendv(int socket, SocketBuffer*& buffers, int& count, int& result, int& error);
+
+    // Receives into 'bufferPtr' until 'delimiter' has been received, 'size' bytes have been received,
+    // or the peer closes the connection. The first 'received' bytes of the buffer are data from an
+    // earlier call, and must not contain the delimiter. The callback's result is the total number
+    // of bytes in the buffer, which may include data past the delimiter. The buffer and 'delimiter'
+    // must live until the callback is invoked.
+    void ReceiveUntil(int socket, char* bufferPtr, size_t size, size_t received, const char* delimiter,
+                      void* context, SocketCallback callback, bool tryFirst = true);
+
+    // Like TryReceive(), but 'received' is the number of bytes in the buffer on input and output.
+    // Blocked may mean part of the data was received, so pass 'received' on to ReceiveUntil().
+    SocketResult TryReceiveUntil(int socket, char* bufferPtr, size_t size, size_t& received, const char* delimiter, int& error);
+
+    // Sends up to 'size' bytes of 'file' starting at 'offset' with sendfile(), without copying them
+    // through user space. The callback's result is the number of bytes sent. io_uring has no
+    // sendfile operation, so this waits in the SocketWaiter with either engine. If sendfile() isn't
+    // supported (SOCKET_SENDFILE_SUPPORTED is 0, or the file type can't be sent) it fails with ENOSYS or EINVAL.
+    void SendFile(int socket, int file, int64_t offset, size_t size, void* context, SocketCallback callback, bool tryFirst = true);
+    SocketResult TrySendFile(int socket, int file, int64_t offset, size_t size, int& result, int& error);
+
+    // must be called before a socket used with the functions above is closed
+    void Release(int socket);
 
     static SocketController instance;
 private:
+    // a wait completes with -1 if the socket was removed from the waiter, which happens when it's
+    // closed. Its handle may already belong to another socket, so the operation fails without using it.
+    static bool FinalizeIfCancelled(void* operation, intmax_t result, void(*finalize)(void* operation, intmax_t result));
+
     static void ContinueConnect(void* operation, intmax_t result);
     static void ContinueAccept(void* operation, intmax_t result);
     static void ContinueSend(void* operation, intmax_t result);
     static void ContinueRecv(void* operation, intmax_t result);
+    static void ContinueSendFile(void* operation, intmax_t result);
+    static void ContinueSendv(void* operation, intmax_t result);
+    static void ContinueReceiveUntil(void* operation, intmax_t result);
 
     static void FinalizeConnect(void* operation, intmax_t result);
     static void FinalizeAccept(void* operation, intmax_t result);
     static void FinalizeSend(void* operation, intmax_t result);
     static void FinalizeReceive(void* operation, intmax_t result);
+    static void FinalizeSendFile(void* operation, intmax_t result);
+    static void FinalizeSendv(void* operation, intmax_t result);
+    static void FinalizeReceiveUntil(void* operation, intmax_t result);
+
+    static void CompleteRingOperation(void* operation, int result, int error);
+    static void FinalizeRingOperation(void* operation, intmax_t result);
+
+    bool TakeSyncBudget();
+
+    // accepts until 'maxCount' sockets are accepted or none are pending. If none
+    // were accepted, returns 0 if the socket would block, or -1 with 'error' set.
+    static int AcceptPending(int socket, int* sockets, int maxCount, int& error);
+
+    // one sendfile() call. Returns the number of bytes sent, or -1 with 'error' set
+    static int SendFilePart(int socket, int file, int64_t offset, size_t size, int& error);
+
+    // one sendmsg()/WSASend() call, capped at MaxSendBuffers buffers. Advances 'buffers' and 'count'
+    // past the data sent, and returns the number of bytes sent, or -1 with 'error' set
+    static int SendvPart(int socket, SocketBuffer*& buffers, int& count, int& error);
+    static void AdvanceBuffers(SocketBuffer*& buffers, int& count, size_t sent);
+
+    // sends the rest of a Sendv() operation until it's done or the socket would block.
+    // Returns false if it would block.
+    static bool SendvPending(SocketOperation* op);
+
+    // receives until ReceiveUntil()'s conditions are met (Completed), the socket would block, or it fails
+    static SocketResult ReceiveUntilPending(int socket, char* bufferPtr, size_t size, size_t& received,
+                                            const char* delimiter, size_t delimiterSize, int& error);
+
+    // true if the delimiter ends in bufferPtr[from, to)
+    static bool FindDelimiter(const char* bufferPtr, size_t from, size_t to, const char* delimiter, size_t delimiterSize);
+
+    // continues a composite operation after an io_uring completion. Returns false if it was resubmitted.
+    bool CompleteRingSendv(SocketOperation* op, intmax_t& result);
+    bool CompleteRingReceiveUntil(SocketOperation* op, intmax_t& result);
+
+    // the calling thread's waiter, created on first use
+    SocketWaiter& GetWaiter();
+    void AddWaiter(SocketWaiter* waiter);
+    void RemoveWaiter(SocketWaiter* waiter);
+
+    // waits for the operation's socket in the calling thread's waiter, and records that waiter as its owner
+    void Wait(SocketOperationType type, SocketOperation* op, void(*callback)(void* operation, intmax_t result));
+
+    // the calling thread's ring, with its waiter recorded as the owner of 'socket'. Null if
+    // the Readiness engine is in use, or io_uring couldn't be set up on this thread.
+    SocketRing* UseRing(int socket);
+
+    // records 'waiter' as the owner of 'socket', or marks it as shared if it already has another owner
+    void RecordOwner(int socket, SocketWaiter& waiter);
+
+    // the entry holding the waiter that 'socket' waits in, or null if 'socket' is out of range,
+    // or if its block hasn't been allocated and 'create' is false
+    std::atomic<SocketWaiter*>* FindOwner(int socket, bool create);
+
+    // removes 'socket' from every waiter
+    void RemoveFromAll(int socket);
+
+    // removes 'socket' from 'waiter', and cancels its operations in the waiter's ring
+    static void RemoveFrom(SocketWaiter* waiter, int socket);
+
+    // Owners of the sockets, indexed by handle, so Release() only visits the waiter a socket waited in,
+    // or whose ring it used. Blocks are allocated as they're needed and kept until exit, so entries are
+    // read without a lock.
+    static constexpr size_t OwnerBlockSize = 4096;
+    static constexpr size_t MaxOwnerBlocks = 1024;
 
-    SocketWaiter socketWaiter;
+    std::atomic<SocketEngine> engine = SocketEngine::Readiness;
+    std::mutex waitersMutex;
+    std::vector<SocketWaiter*> waiters;
+    std::atomic<std::atomic<SocketWaiter*>*> ownerBlocks[MaxOwnerBlocks] = {};
 };
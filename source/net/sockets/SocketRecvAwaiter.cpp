@@ -16,8 +16,12 @@ SocketRecvAwaiter::SocketRecvAwaiter(int socket, char* bufferPtr, size_t bufferS
 {
 }
 
-bool SocketRecvAwaiter::ready() {
-    return false;
+bool SocketRecvAwaiter::ready()
+{
+    // most operations complete immediately, so the coroutine
+    // can continue without being suspended and resumed later
+    attempt = SocketController::instance.TryReceive(socket, bufferPtr, bufferSize, result, error);
+    return attempt == SocketResult::Completed || attempt == SocketResult::Failed;
 }
 
 void SocketRecvAwaiter::suspend(std::experimental::coroutine_handle<> handle)
@@ -31,7 +35,8 @@ void SocketRecvAwaiter::suspend(std::experimental::coroutine_handle<> handle)
             awaiter->result = result;
             awaiter->error = error;
             awaiter->handle.resume();
-        });
+        },
+        attempt != SocketResult::Blocked);
 }
 
 int SocketRecvAwaiter::resume()
@@ -15,6 +15,7 @@
 #include <system/Task.h>
 #include <system/Awaiter.h>
 #include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
 
 struct SocketRecvAwaiter : public Awaiter<int>
 {
@@ -24,6 +25,7 @@ struct SocketRecvAwaiter : public Awaiter<int>
     int socket = -1;
     int result = 0;
     int error = 0;
+    SocketResult attempt = SocketResult::Deferred;
 
     SocketRecvAwaiter() = delete;
     SocketRecvAwaiter(int socket, char* bufferPtr, size_t bufferSize);
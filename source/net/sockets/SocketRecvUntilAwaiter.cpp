@@ -0,0 +1,52 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <stdexcept>
+#include <net/sockets/SocketRecvUntilAwaiter.h>
+#include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketController.h>
+#include <net/sockets/socket_error.h>
+
+using namespace std;
+
+SocketRecvUntilAwaiter::SocketRecvUntilAwaiter(int socket, char* bufferPtr, size_t bufferSize, const char* delimiter)
+    : socket(socket), bufferPtr(bufferPtr), bufferSize(bufferSize), delimiter(delimiter)
+{
+}
+
+bool SocketRecvUntilAwaiter::ready()
+{
+    attempt = SocketController::instance.TryReceiveUntil(socket, bufferPtr, bufferSize, received, delimiter, error);
+
+    if (attempt == SocketResult::Completed || attempt == SocketResult::Failed) {
+        result = attempt == SocketResult::Completed ? (int)received : -1;
+        return true;
+    }
+
+    return false;
+}
+
+void SocketRecvUntilAwaiter::suspend(std::experimental::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    SocketController::instance.ReceiveUntil(
+        socket, bufferPtr, bufferSize, received, delimiter, this,
+        [](int result, int error, void* context) {
+            auto awaiter = (SocketRecvUntilAwaiter*)context;
+            awaiter->result = result;
+            awaiter->error = error;
+            awaiter->handle.resume();
+        },
+        attempt != SocketResult::Blocked);
+}
+
+int SocketRecvUntilAwaiter::resume()
+{
+    if (result == -1)
+        throw socket_error("recv operation failed", error);
+
+    return result;
+}
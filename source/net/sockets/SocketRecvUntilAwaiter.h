@@ -0,0 +1,36 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstdint>
+#include <experimental/coroutine>
+#include <system/Dispatcher.h>
+#include <system/Task.h>
+#include <system/Awaiter.h>
+#include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
+
+struct SocketRecvUntilAwaiter : public Awaiter<int>
+{
+    std::experimental::coroutine_handle<> handle;
+    int socket = -1;
+    char* bufferPtr;
+    size_t bufferSize;
+    const char* delimiter;
+    size_t received = 0;    // received by ready() before the socket blocked
+    int result = 0;
+    int error = 0;
+    SocketResult attempt = SocketResult::Deferred;
+
+    SocketRecvUntilAwaiter() = delete;
+    SocketRecvUntilAwaiter(int socket, char* bufferPtr, size_t bufferSize, const char* delimiter);
+
+    SocketRecvUntilAwaiter(const SocketRecvUntilAwaiter&) = delete;
+    SocketRecvUntilAwaiter& operator=(const SocketRecvUntilAwaiter&) = delete;
+
+    bool ready() override;
+    void suspend(std::experimental::coroutine_handle<> handle) override;
+    int resume() override;
+};
@@ -0,0 +1,523 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <net/sockets/SocketRing.h>
+#include <system/Console.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if SOCKET_RING_SUPPORTED
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+namespace
+{
+#if SOCKET_RING_SUPPORTED
+    template<class T>
+    T* RingPointer(void* ring, unsigned offset) {
+        return (T*)((char*)ring + offset);
+    }
+#endif
+}
+
+SocketRing::SocketRing()
+{
+}
+
+SocketRing::~SocketRing()
+{
+    Close();
+}
+
+bool SocketRing::IsOpen() const {
+    return ringHandle != -1;
+}
+
+#if SOCKET_RING_SUPPORTED
+
+bool SocketRing::IsSupported()
+{
+    static const bool supported = [] {
+        SocketRing ring;
+        return ring.Setup(2) && ring.Probe();
+    }();
+
+    return supported;
+}
+
+bool SocketRing::Open(SocketRingCallback callback)
+{
+    if (ringHandle != -1)
+        return true;
+
+    if (!IsSupported() || !Setup(RingEntries))
+        return false;
+
+    this->callback = callback;
+
+    // operations are submitted after each request the dispatcher invokes, so they
+    // aren't held up by the rest of its queue, and once more before it waits for work
+    Dispatcher::current().AddIterationHandler(&SocketRing::FlushCallback, this);
+    Dispatcher::current().AddIdleHandler(&SocketRing::FlushCallback, this);
+
+    return true;
+}
+
+bool SocketRing::Setup(unsigned entries)
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    int handle = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (handle == -1)
+        return false;
+
+    // socket operations have to wait for readiness inside the kernel, instead of blocking one of its workers
+    if ((params.features & IORING_FEAT_FAST_POLL) == 0) {
+        close(handle);
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, IORING_OFF_SQ_RING);
+    cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, IORING_OFF_CQ_RING);
+    void* sqesPtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, IORING_OFF_SQES);
+
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqesPtr == MAP_FAILED)
+    {
+        if (sqesPtr != MAP_FAILED) munmap(sqesPtr, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        sqRing = cqRing = nullptr;
+        close(handle);
+        return false;
+    }
+
+    sqHead = RingPointer<unsigned>(sqRing, params.sq_off.head);
+    sqTail = RingPointer<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = RingPointer<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqArray = RingPointer<unsigned>(sqRing, params.sq_off.array);
+    sqEntries = params.sq_entries;
+    sqes = (io_uring_sqe*)sqesPtr;
+
+    cqHead = RingPointer<unsigned>(cqRing, params.cq_off.head);
+    cqTail = RingPointer<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = RingPointer<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = RingPointer<io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+    // Cancel() checks this from other threads
+    std::lock_guard<std::mutex> lk(mut);
+    ringHandle = handle;
+
+    return true;
+}
+
+bool SocketRing::Probe()
+{
+    static const int usedOps[] = {
+        IORING_OP_CONNECT,
+        IORING_OP_ACCEPT,
+        IORING_OP_SEND,
+        IORING_OP_RECV,
+        IORING_OP_WRITEV,
+        IORING_OP_ASYNC_CANCEL
+    };
+
+    constexpr unsigned MaxOps = 256;
+
+    // the kernel only fills in a zeroed probe
+    std::vector<char> buffer(sizeof(io_uring_probe) + MaxOps * sizeof(io_uring_probe_op));
+    auto probe = (io_uring_probe*)buffer.data();
+
+    if (syscall(__NR_io_uring_register, ringHandle, IORING_REGISTER_PROBE, probe, MaxOps) == -1)
+        return false;
+
+    for (int op : usedOps)
+    {
+        if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)
+            return false;
+    }
+
+    // The probe doesn't cover flags. Cancelation by file descriptor came with multishot accept,
+    // and older kernels fail a cancelation with any flags with EINVAL, so try one.
+    std::lock_guard<std::mutex> lk(mut);
+
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ringHandle, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    unsigned head = *cqHead;
+    if (ret == -1 || head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    int result = cqes[head & *cqMask].res;
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    pending = 0;
+
+    return result != -EINVAL;
+}
+
+void SocketRing::Close()
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    if (ringHandle == -1)
+        return;
+
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+    close(ringHandle);
+
+    for (auto& it : accepts) {
+        for (int socket : it.second->ready)
+            close(socket);
+    }
+
+    accepts.clear();
+    closingAccepts.clear();
+    completions.clear();
+    sqRing = cqRing = nullptr;
+    sqes = nullptr;
+    cqes = nullptr;
+    ringHandle = -1;
+    pending = 0;
+}
+
+void SocketRing::Connect(int socket, const sockaddr* address, socklen_t addressLength, void* context)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = socket;
+    sqe->addr = (uint64_t)address;
+    sqe->off = addressLength;
+    sqe->user_data = (uint64_t)context;
+}
+
+void SocketRing::Accept(int socket, int* sockets, int maxCount, void* context)
+{
+    int count;
+
+    {
+        std::lock_guard<std::mutex> lk(mut);
+
+        auto& state = accepts[socket];
+        if (!state) {
+            state = std::make_unique<AcceptState>();
+            state->socket = socket;
+        }
+
+        if (state->ready.empty())
+        {
+            state->waiting.push_back(AcceptRequest{ context, sockets, maxCount });
+
+            if (!state->armed)
+                PrepareAccept(state.get());
+
+            return;
+        }
+
+        count = TakeReady(state.get(), sockets, maxCount);
+    }
+
+    // the callback may start another operation
+    callback(context, count, 0);
+}
+
+void SocketRing::Send(int socket, const char* bufferPtr, size_t bufferSize, void* context)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = socket;
+    sqe->addr = (uint64_t)bufferPtr;
+    sqe->len = (uint32_t)std::min(bufferSize, (size_t)UINT32_MAX);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)context;
+}
+
+void SocketRing::Sendv(int socket, const SocketBuffer* buffers, int count, void* context)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    // SIGPIPE is ignored by SocketController, so writev doesn't need MSG_NOSIGNAL
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = socket;
+    sqe->addr = (uint64_t)buffers;
+    sqe->len = (uint32_t)count;
+    sqe->off = 0;
+    sqe->user_data = (uint64_t)context;
+}
+
+void SocketRing::Receive(int socket, char* bufferPtr, size_t bufferSize, void* context)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->addr = (uint64_t)bufferPtr;
+    sqe->len = (uint32_t)std::min(bufferSize, (size_t)UINT32_MAX);
+    sqe->user_data = (uint64_t)context;
+}
+
+void SocketRing::Cancel(int socket)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    if (ringHandle == -1)
+        return;
+
+    auto it = accepts.find(socket);
+    if (it != accepts.end())
+    {
+        auto& state = it->second;
+        state->closing = true;
+
+        // passed on by the owning thread's next Reap()
+        for (auto& request : state->waiting)
+            completions.push_back(Completion{ request.context, -1, ECANCELED });
+
+        for (int clientSocket : state->ready)
+            close(clientSocket);
+
+        state->waiting.clear();
+        state->ready.clear();
+
+        // keep the state alive until the kernel is done with it
+        if (state->armed)
+            closingAccepts.push_back(std::move(state));
+
+        accepts.erase(it);
+    }
+
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = socket;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+
+    // the socket is about to be closed, so this can't wait for the next flush. Its completion
+    // also wakes the owning thread if it's polling, so any canceled accepts are passed on.
+    SubmitPending();
+}
+
+void SocketRing::Flush()
+{
+    if (pending == 0)
+        return;
+
+    std::lock_guard<std::mutex> lk(mut);
+    SubmitPending();
+}
+
+void SocketRing::Reap()
+{
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        ReapCompletions();
+
+        // re-armed accepts
+        SubmitPending();
+
+        invoking.swap(completions);
+    }
+
+    // callbacks may start new operations, so they're invoked without holding 'mut'
+    for (auto& completion : invoking)
+        callback(completion.context, completion.result, completion.error);
+
+    invoking.clear();
+}
+
+void SocketRing::SubmitPending()
+{
+    while (pending != 0)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, ringHandle, (unsigned)pending, 0, 0, nullptr, 0);
+        if (ret == -1)
+        {
+            int err = errno;
+            if (err == EINTR)
+                continue;
+
+            // EAGAIN/EBUSY: the kernel is backed up, try again on the next flush
+            if (err != EAGAIN && err != EBUSY)
+                Console::WriteLine("failed to submit socket operations: %", err);
+
+            break;
+        }
+
+        pending -= (unsigned)ret;
+    }
+}
+
+// must be called with 'mut' locked. The entry is zeroed and already
+// published to the ring, which is fine because the kernel only reads
+// it from SubmitPending(), which also requires 'mut'.
+io_uring_sqe* SocketRing::GetSubmission()
+{
+    unsigned tail = *sqTail;
+
+    // a full ring is submitted until the kernel has taken enough entries to free one. If it's
+    // refusing them because its completion queue is backed up, the completions are moved out
+    // of the way here, and passed on by the next Reap().
+    while (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+    {
+        SubmitPending();
+
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries && !ReapCompletions())
+            std::this_thread::yield();
+    }
+
+    unsigned index = tail & *sqMask;
+    auto sqe = &sqes[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pending;
+
+    return sqe;
+}
+
+void SocketRing::PrepareAccept(AcceptState* state)
+{
+    auto sqe = GetSubmission();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = state->socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)state | 1; // tagged to tell it apart from a callback context
+    state->armed = true;
+}
+
+int SocketRing::TakeReady(AcceptState* state, int* sockets, int maxCount)
+{
+    int count = 0;
+
+    while (count < maxCount && !state->ready.empty()) {
+        sockets[count++] = state->ready.front();
+        state->ready.pop_front();
+    }
+
+    return count;
+}
+
+void SocketRing::CompleteAccept(AcceptState* state, int result, unsigned flags)
+{
+    if (result >= 0)
+    {
+        if (state->closing) {
+            close(result);
+        }
+        else if (!state->waiting.empty())
+        {
+            auto request = state->waiting.front();
+            state->waiting.pop_front();
+
+            // sockets accepted since the last call go out in the same batch
+            request.sockets[0] = result;
+            int count = 1 + TakeReady(state, request.sockets + 1, request.maxCount - 1);
+            completions.push_back(Completion{ request.context, count, 0 });
+        }
+        else {
+            state->ready.push_back(result);
+        }
+    }
+    else if (!state->closing && !state->waiting.empty())
+    {
+        auto request = state->waiting.front();
+        state->waiting.pop_front();
+        completions.push_back(Completion{ request.context, -1, -result });
+    }
+
+    if ((flags & IORING_CQE_F_MORE) == 0)
+    {
+        state->armed = false;
+
+        if (state->closing)
+        {
+            auto it = std::find_if(closingAccepts.begin(), closingAccepts.end(),
+                [state](auto& s) { return s.get() == state; });
+
+            if (it != closingAccepts.end())
+                closingAccepts.erase(it);
+        }
+        else if (!state->waiting.empty())
+        {
+            PrepareAccept(state);
+        }
+    }
+}
+
+// must be called with 'mut' locked. Each entry is consumed before it's handled, because
+// re-arming an accept can get here again through GetSubmission().
+bool SocketRing::ReapCompletions()
+{
+    bool reaped = false;
+
+    for (;;)
+    {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+            break;
+
+        io_uring_cqe cqe = cqes[head & *cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        reaped = true;
+
+        // cancelations
+        if (cqe.user_data == 0)
+            continue;
+
+        if (cqe.user_data & 1)
+            CompleteAccept((AcceptState*)(cqe.user_data & ~(uint64_t)1), cqe.res, cqe.flags);
+        else
+            completions.push_back(Completion{ (void*)cqe.user_data, cqe.res < 0 ? -1 : cqe.res, cqe.res < 0 ? -cqe.res : 0 });
+    }
+
+    return reaped;
+}
+
+void SocketRing::FlushCallback(void* ring) {
+    ((SocketRing*)ring)->Flush();
+}
+
+#else
+
+bool SocketRing::IsSupported() { return false; }
+bool SocketRing::Open(SocketRingCallback callback) { return false; }
+void SocketRing::Close() {}
+void SocketRing::Connect(int socket, const sockaddr* address, socklen_t addressLength, void* context) {}
+void SocketRing::Accept(int socket, int* sockets, int maxCount, void* context) {}
+void SocketRing::Send(int socket, const char* bufferPtr, size_t bufferSize, void* context) {}
+void SocketRing::Receive(int socket, char* bufferPtr, size_t bufferSize, void* context) {}
+void SocketRing::Sendv(int socket, const SocketBuffer* buffers, int count, void* context) {}
+void SocketRing::Cancel(int socket) {}
+void SocketRing::Flush() {}
+void SocketRing::Reap() {}
+
+#endif
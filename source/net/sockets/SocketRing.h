@@ -0,0 +1,151 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <net/sockets/OSSockets.h>
+#include <net/sockets/Socket.h>
+#include <system/Dispatcher.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define SOCKET_RING_SUPPORTED 1
+    #include <linux/io_uring.h>
+#else
+    #define SOCKET_RING_SUPPORTED 0
+#endif
+
+// result: >= 0 for success, -1 for error.
+// error: the errno if result is -1
+typedef void(*SocketRingCallback)(void* context, int result, int error);
+
+// Completion based socket I/O using io_uring (Linux 5.19+), owned by one dispatcher thread.
+// Operations are queued in the submission ring, and submitted in one batch after each
+// request the dispatcher invokes, and before it waits for more. The thread's SocketWaiter
+// polls handle() along with its sockets, and calls Reap() to pass the completions to the
+// callback given to Open() on the same thread.
+class SocketRing
+{
+    static constexpr unsigned RingEntries = 1024;
+
+    // a pending Accept() call
+    struct AcceptRequest
+    {
+        void* context;
+        int* sockets;
+        int maxCount;
+    };
+
+    // multishot accept for one listening socket
+    struct AcceptState
+    {
+        int socket = -1;
+        bool armed = false;
+        bool closing = false;
+        std::deque<int> ready;               // accepted sockets nobody has asked for yet
+        std::deque<AcceptRequest> waiting;
+    };
+
+    // a completion waiting to be passed to the callback
+    struct Completion
+    {
+        void* context;
+        int result;
+        int error;
+    };
+
+public:
+    SocketRing();
+    ~SocketRing();
+
+    SocketRing(const SocketRing&) = delete;
+    SocketRing& operator=(const SocketRing&) = delete;
+
+    // true if the kernel supports the operations and flags used here. Only checked once.
+    static bool IsSupported();
+
+    // returns false if io_uring is not available. Must be called on the owning dispatcher's thread.
+    bool Open(SocketRingCallback callback);
+    void Close();
+    bool IsOpen() const;
+
+    // polls readable while there are completions to reap
+    int handle() const { return ringHandle; }
+
+    // The operations below must be called on the owning thread.
+    // Buffers and 'address' must live until the callback is invoked.
+    void Connect(int socket, const sockaddr* address, socklen_t addressLength, void* context);
+
+    // accepts up to 'maxCount' sockets into 'sockets'. The callback's result is the number accepted.
+    // Accepted sockets are non-blocking.
+    void Accept(int socket, int* sockets, int maxCount, void* context);
+
+    void Send(int socket, const char* bufferPtr, size_t bufferSize, void* context);
+    void Receive(int socket, char* bufferPtr, size_t bufferSize, void* context);
+
+    // one writev of up to 'count' buffers, which may be a partial write
+    void Sendv(int socket, const SocketBuffer* buffers, int count, void* context);
+
+    // cancels everything pending on 'socket'. Must be called before 'socket' is closed.
+    // May be called from any thread.
+    void Cancel(int socket);
+
+    // submits all queued operations
+    void Flush();
+
+    // passes the operations that have completed to the callback. Must be called on the owning thread.
+    void Reap();
+
+private:
+#if SOCKET_RING_SUPPORTED
+    bool Setup(unsigned entries);
+    bool Probe();
+    void SubmitPending();
+    io_uring_sqe* GetSubmission();
+    void PrepareAccept(AcceptState* state);
+    void CompleteAccept(AcceptState* state, int result, unsigned flags);
+    static int TakeReady(AcceptState* state, int* sockets, int maxCount);
+    bool ReapCompletions();
+
+    static void FlushCallback(void* ring);
+#endif
+
+    SocketRingCallback callback = nullptr;
+    int ringHandle = -1;
+
+    // guards the submission ring and 'accepts', for Cancel() calls from other threads
+    std::mutex mut;
+    std::atomic<unsigned> pending = 0;
+    std::unordered_map<int, std::unique_ptr<AcceptState>> accepts;
+    std::vector<std::unique_ptr<AcceptState>> closingAccepts;
+    std::vector<Completion> completions; // guarded by 'mut'
+    std::vector<Completion> invoking;    // only used by Reap()
+
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+
+#if SOCKET_RING_SUPPORTED
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+#endif
+};
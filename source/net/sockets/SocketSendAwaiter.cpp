@@ -16,8 +16,12 @@ SocketSendAwaiter::SocketSendAwaiter(int socket, const char* bufferPtr, size_t b
 {
 }
 
-bool SocketSendAwaiter::ready() {
-    return false;
+bool SocketSendAwaiter::ready()
+{
+    // most operations complete immediately, so the coroutine
+    // can continue without being suspended and resumed later
+    attempt = SocketController::instance.TrySend(socket, bufferPtr, bufferSize, result, error);
+    return attempt == SocketResult::Completed || attempt == SocketResult::Failed;
 }
 
 void SocketSendAwaiter::suspend(std::experimental::coroutine_handle<> handle)
@@ -31,7 +35,8 @@ void SocketSendAwaiter::suspend(std::experimental::coroutine_handle<> handle)
             awaiter->result = result;
             awaiter->error = error;
             awaiter->handle.resume();
-        });
+        },
+        attempt != SocketResult::Blocked);
 }
 
 int SocketSendAwaiter::resume()
@@ -15,6 +15,7 @@
 #include <system/Task.h>
 #include <system/Awaiter.h>
 #include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
 
 struct SocketSendAwaiter : public Awaiter<int>
 {
@@ -24,6 +25,7 @@ struct SocketSendAwaiter : public Awaiter<int>
     int socket = -1;
     int result = 0;
     int error = 0;
+    SocketResult attempt = SocketResult::Deferred;
 
     SocketSendAwaiter() = delete;
     SocketSendAwaiter(int socket, const char* bufferPtr, size_t bufferSize);
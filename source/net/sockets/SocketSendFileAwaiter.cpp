@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <stdexcept>
+#include <net/sockets/SocketSendFileAwaiter.h>
+#include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketController.h>
+#include <net/sockets/socket_error.h>
+
+using namespace std;
+
+SocketSendFileAwaiter::SocketSendFileAwaiter(int socket, int file, int64_t offset, size_t size)
+    : socket(socket), file(file), offset(offset), size(size)
+{
+}
+
+bool SocketSendFileAwaiter::ready()
+{
+    attempt = SocketController::instance.TrySendFile(socket, file, offset, size, result, error);
+    return attempt == SocketResult::Completed || attempt == SocketResult::Failed;
+}
+
+void SocketSendFileAwaiter::suspend(std::experimental::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    SocketController::instance.SendFile(
+        socket, file, offset, size, this,
+        [](int result, int error, void* context) {
+            auto awaiter = (SocketSendFileAwaiter*)context;
+            awaiter->result = result;
+            awaiter->error = error;
+            awaiter->handle.resume();
+        },
+        attempt != SocketResult::Blocked);
+}
+
+int SocketSendFileAwaiter::resume()
+{
+    if (result == -1)
+        throw socket_error("sendfile operation failed", error);
+
+    return result;
+}
@@ -0,0 +1,35 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstdint>
+#include <experimental/coroutine>
+#include <system/Dispatcher.h>
+#include <system/Task.h>
+#include <system/Awaiter.h>
+#include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
+
+struct SocketSendFileAwaiter : public Awaiter<int>
+{
+    std::experimental::coroutine_handle<> handle;
+    int socket = -1;
+    int file = -1;
+    int64_t offset = 0;
+    size_t size = 0;
+    int result = 0;
+    int error = 0;
+    SocketResult attempt = SocketResult::Deferred;
+
+    SocketSendFileAwaiter() = delete;
+    SocketSendFileAwaiter(int socket, int file, int64_t offset, size_t size);
+
+    SocketSendFileAwaiter(const SocketSendFileAwaiter&) = delete;
+    SocketSendFileAwaiter& operator=(const SocketSendFileAwaiter&) = delete;
+
+    bool ready() override;
+    void suspend(std::experimental::coroutine_handle<> handle) override;
+    int resume() override;
+};
@@ -0,0 +1,57 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <stdexcept>
+#include <net/sockets/SocketSendvAwaiter.h>
+#include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketController.h>
+#include <net/sockets/socket_error.h>
+
+using namespace std;
+
+SocketSendvAwaiter::SocketSendvAwaiter(int socket, SocketBuffer* buffers, int count)
+    : socket(socket), buffers(buffers), count(count)
+{
+}
+
+SocketSendvAwaiter::SocketSendvAwaiter(int socket, const char* bufferPtr, size_t bufferSize)
+    : socket(socket), buffers(&single), count(1), single(bufferPtr, bufferSize)
+{
+}
+
+bool SocketSendvAwaiter::ready()
+{
+    attempt = SocketController::instance.TrySendv(socket, buffers, count, sent, error);
+    
+    if (attempt == SocketResult::Completed || attempt == SocketResult::Failed) {
+        result = sent;
+        return true;
+    }
+
+    return false;
+}
+
+void SocketSendvAwaiter::suspend(std::experimental::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    SocketController::instance.Sendv(
+        socket, buffers, count, this,
+        [](int result, int error, void* context) {
+            auto awaiter = (SocketSendvAwaiter*)context;
+            awaiter->result = result == -1 ? -1 : awaiter->sent + result;
+            awaiter->error = error;
+            awaiter->handle.resume();
+        },
+        attempt != SocketResult::Blocked);
+}
+
+int SocketSendvAwaiter::resume()
+{
+    if (result == -1)
+        throw socket_error("send operation failed", error);
+
+    return result;
+}
@@ -0,0 +1,37 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstdint>
+#include <experimental/coroutine>
+#include <system/Dispatcher.h>
+#include <system/Task.h>
+#include <system/Awaiter.h>
+#include <net/sockets/Socket.h>
+#include <net/sockets/SocketController.h>
+
+struct SocketSendvAwaiter : public Awaiter<int>
+{
+    std::experimental::coroutine_handle<> handle;
+    int socket = -1;
+    SocketBuffer* buffers = nullptr;
+    int count = 0;
+    SocketBuffer single;    // 'buffers' for SendAllAsync()
+    int sent = 0;       // sent by ready() before the socket blocked
+    int result = 0;
+    int error = 0;
+    SocketResult attempt = SocketResult::Deferred;
+
+    SocketSendvAwaiter() = delete;
+    SocketSendvAwaiter(int socket, SocketBuffer* buffers, int count);
+    SocketSendvAwaiter(int socket, const char* bufferPtr, size_t bufferSize);
+
+    SocketSendvAwaiter(const SocketSendvAwaiter&) = delete;
+    SocketSendvAwaiter& operator=(const SocketSendvAwaiter&) = delete;
+
+    bool ready() override;
+    void suspend(std::experimental::coroutine_handle<> handle) override;
+    int resume() override;
+};
@@ -11,6 +11,7 @@
 #include <mutex>
 #include <thread>
 #include <algorithm>
+#include <climits>
 
 namespace
 {
@@ -22,100 +23,348 @@ namespace
     };
 }
 
-SocketWaiter::SocketWaiter()
+SocketWaiter::SocketWaiter(SocketWaiterBackend preferred)
 {
-    Socket tmp(AddressFamily::InterNetwork, SocketType::Stream, ProtocolType::TCP);
-    tmp.Bind(RequestWakePort, nullptr, true);
-    tmp.Listen();
-    
-    wakeSockets[0] = Socket(AddressFamily::InterNetwork, SocketType::Stream, ProtocolType::TCP);
-    wakeSockets[0].Connect(RequestWakePort, LoopbackAddress);
-    wakeSockets[1] = tmp.Accept();
-    wakeSockets[1].SetBlocking(false);
-    
-    tmp.Close();
-    
     sockets.reserve(64);
     pollfds.reserve(64);
 
-    sockets.push_back(SocketWaitInfo{ SocketOperationType::Recv, wakeSockets[1].handle(), nullptr, nullptr, nullptr });
-    pollfds.push_back(pollfd{ (Socket::HandleType)wakeSockets[1].handle(), POLLRDNORM, 0 });
+    // placeholder for the wake event, so sockets[i] lines up with pollfds[i]
+    sockets.push_back(SocketWaitInfo{ SocketOperationType::Recv, wakeEvent.handle(), nullptr, nullptr, nullptr });
+
+#ifdef __linux__
+    if (preferred == SocketWaiterBackend::Epoll)
+    {
+        epollHandle = epoll_create1(EPOLL_CLOEXEC);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeEvent.handle();
+
+        if (epollHandle != -1 && epoll_ctl(epollHandle, EPOLL_CTL_ADD, ev.data.fd, &ev) != -1)
+        {
+            backend = SocketWaiterBackend::Epoll;
+            registrations.resize(1024);
+            epollEvents.resize(MaxEpollEvents);
+        }
+        else
+        {
+            Console::WriteLine("failed to create epoll instance, using poll: %", (int)errno);
+        }
+    }
+#endif
 
-    run = true;
-    runLoopThread = std::thread(&SocketWaiter::RunLoop, this);
+    ownerThread = std::this_thread::get_id();
+    dispatcher = &Dispatcher::current();
+    dispatcher->SetPoller(this);
 }
 
 SocketWaiter::~SocketWaiter()
 {
-    run = false;
-    Wake();
-    runLoopThread.join();
+    if (dispatcher->GetPoller() == this)
+        dispatcher->SetPoller(nullptr);
+
+    if (epollHandle != -1)
+        close(epollHandle);
 }
 
 bool SocketWaiter::Wait(SocketOperationType type, int socket, void* context, void(*callback)(void* context, intmax_t num), Dispatcher* dispatcher)
 {
+    if (backend == SocketWaiterBackend::Epoll)
+        return WaitEpoll(SocketWaitInfo{ type, socket, context, callback, dispatcher });
+
+    // only the owning thread adds waits, and it isn't blocked in poll() while doing so
     std::lock_guard<std::mutex> lk(mut);
     sockets.push_back(SocketWaitInfo{ type, socket, context, callback, dispatcher });
-    
-    Wake();
 
     return true;
 }
 
-void SocketWaiter::Wake() {
-    wakeSockets[0].Send("w", 1);
+void SocketWaiter::Remove(int socket)
+{
+    if (backend == SocketWaiterBackend::Epoll) {
+        RemoveEpoll(socket);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(mut);
+
+    auto removed = std::stable_partition(sockets.begin() + 1, sockets.end(),
+        [socket](const SocketWaitInfo& info) { return info.socket != socket; });
+
+    for (auto it = removed; it != sockets.end(); ++it)
+        it->dispatcher->InvokeAsync(it->callback, it->context, -1);
+
+    sockets.erase(removed, sockets.end());
 }
 
-void SocketWaiter::RunLoop()
+SocketRing* SocketWaiter::OpenRing(SocketRingCallback callback)
 {
-    while (run) {
-        UpdateOperations();
-        WaitForEvents();
+    if (ring.IsOpen())
+        return &ring;
+
+    if (ringFailed || !ring.Open(callback)) {
+        ringFailed = true;
+        return nullptr;
     }
+
+#ifdef __linux__
+    // level-triggered, so completions left for the next Poll() keep it from blocking
+    if (backend == SocketWaiterBackend::Epoll)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = ring.handle();
+
+        if (epoll_ctl(epollHandle, EPOLL_CTL_ADD, ev.data.fd, &ev) == Socket::SocketError)
+        {
+            Console::WriteLine("failed to register io_uring instance: %", (int)errno);
+            ring.Close();
+            ringFailed = true;
+            return nullptr;
+        }
+    }
+#endif
+
+    return &ring;
 }
 
-void SocketWaiter::UpdateOperations()
+void SocketWaiter::Poll(std::chrono::milliseconds timeout)
 {
+    int millis = timeout.count() < 0 ? -1 : (int)std::min<std::chrono::milliseconds::rep>(timeout.count(), INT_MAX);
+
+    if (backend == SocketWaiterBackend::Epoll)
+        PollEpoll(millis);
+    else
+        PollSockets(millis);
+
+    InvokeCompletions();
+
+    if (ring.IsOpen())
+        ring.Reap();
+}
+
+void SocketWaiter::Wake()
+{
+    // the owning thread can't be blocked in Poll() while it's calling this
+    if (std::this_thread::get_id() != ownerThread)
+        wakeEvent.Signal();
+}
+
+void SocketWaiter::InvokeCompletions()
+{
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        invoking.swap(completions);
+    }
+
+    // callbacks may start new waits, so they're invoked without holding 'mut'
+    for (auto& completion : invoking)
+    {
+        auto& info = completion.first;
+        info.callback(info.context, completion.second);
+    }
+
+    invoking.clear();
+}
+
+void SocketWaiter::PollSockets(int timeout)
+{
+    {
+        std::lock_guard<std::mutex> lk(mut);
+
+        pollfds.clear();
+
+        pollfds.push_back(pollfd{ (Socket::HandleType)wakeEvent.handle(), POLLIN, 0 });
+
+        for (size_t i = 1; i < sockets.size(); ++i)
+        {
+            auto& info = sockets[i];
+            auto events = pollEventTypes[(int)info.type];
+            auto socket = (Socket::HandleType)info.socket;
+            pollfds.push_back(pollfd{ socket, events, 0 });
+        }
+
+        // after the sockets, so they still line up with 'sockets'. Reaped by Poll().
+        if (ring.IsOpen())
+            pollfds.push_back(pollfd{ (Socket::HandleType)ring.handle(), POLLIN, 0 });
+    }
+
+    int ret = poll(pollfds.data(), (nfds_t)pollfds.size(), timeout);
+    if (ret == Socket::SocketError)
+    {
+        if (errno != EINTR)
+            Console::WriteLine("failed to poll sockets: %", (int)errno);
+
+        return;
+    }
+
+    if (ret == 0)
+        return;
+
     std::lock_guard<std::mutex> lk(mut);
 
-    for (size_t i = 1; i < pollfds.size(); ++i)
+    if (pollfds[0].revents)
+        wakeEvent.Reset();
+
+    // Remove() may have erased sockets during poll(), so what's left is in the same order as
+    // 'pollfds', but may skip some of them. Nothing else changes 'sockets' while this thread polls.
+    size_t kept = 1;
+
+    for (size_t i = 1, j = 1; j < sockets.size(); ++i, ++j)
     {
-        auto& info = sockets[i];
+        while (pollfds[i].fd != (Socket::HandleType)sockets[j].socket)
+            ++i;
+
         auto revents = pollfds[i].revents;
 
         if (revents) {
-            int result = (revents & (POLLRDNORM | POLLWRNORM | POLLHUP)) ? 0 : -1;
-            info.dispatcher->InvokeAsync(info.callback, info.context, result);
+            // errors are reported by the next operation on the socket. POLLNVAL means it was closed.
+            int result = (revents & POLLNVAL) ? -1 : 0;
+            completions.emplace_back(sockets[j], result);
+        }
+        else {
+            sockets[kept++] = sockets[j];
         }
     }
 
-    for (size_t i = pollfds.size() - 1; i != 0; --i)
+    sockets.resize(kept);
+}
+
+#ifdef __linux__
+
+bool SocketWaiter::WaitEpoll(const SocketWaitInfo& info)
+{
+    std::lock_guard<std::mutex> lk(mut);
+
+    if ((size_t)info.socket >= registrations.size())
+        registrations.resize(std::max(registrations.size() * 2, (size_t)info.socket + 1));
+
+    auto& reg = registrations[info.socket];
+
+    if (!reg.registered)
     {
-        if (pollfds[i].revents)
-            sockets.erase(sockets.begin() + i);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = info.socket;
+
+        if (epoll_ctl(epollHandle, EPOLL_CTL_ADD, info.socket, &ev) == Socket::SocketError && errno != EEXIST)
+        {
+            Console::WriteLine("failed to register socket: %", (int)errno);
+            info.dispatcher->InvokeAsync(info.callback, info.context, -1);
+            return false;
+        }
+
+        reg.registered = true;
     }
 
-    pollfds.clear();
+    bool isWrite = info.type == SocketOperationType::Connect || info.type == SocketOperationType::Send;
+    auto& slot = isWrite ? reg.writer : reg.reader;
+    auto& ready = isWrite ? reg.writable : reg.readable;
+    
+    slot = info;
 
-    for (size_t i = 0; i < sockets.size(); ++i)
+    // An edge that arrived between the failed syscall and this call would otherwise be lost.
+    // The flag may be stale if a later syscall already drained the socket, so confirm it first.
+    if (ready)
     {
-        auto& info = sockets[i];
-        auto events = pollEventTypes[(int)info.type];
-        auto socket = (Socket::HandleType)info.socket;
+        ready = false;
 
-        pollfds.push_back(pollfd{ socket, events, 0 });
+        pollfd pfd{ info.socket, (short)(isWrite ? POLLOUT : POLLIN), 0 };
+        if (poll(&pfd, 1, 0) > 0)
+        {
+            slot.callback = nullptr;
+            info.dispatcher->InvokeAsync(info.callback, info.context, 0);
+        }
     }
+
+    return true;
 }
 
-void SocketWaiter::WaitForEvents()
+void SocketWaiter::RemoveEpoll(int socket)
 {
-    // clear the wake socket
-    char wakeBytes[1024];
-    while (wakeSockets[1].Recv(wakeBytes, sizeof(wakeBytes)) > 0) {}
+    std::lock_guard<std::mutex> lk(mut);
 
-    // poll for socket events
-    int millis = -1;
-    int ret = poll(pollfds.data(), (nfds_t)pollfds.size(), millis);
-    if (ret == Socket::SocketError)
-        Console::WriteLine("failed to poll sockets: %", (int)errno);
+    if ((size_t)socket >= registrations.size() || !registrations[socket].registered)
+        return;
+
+    epoll_ctl(epollHandle, EPOLL_CTL_DEL, socket, nullptr);
+
+    auto& reg = registrations[socket];
+
+    if (reg.reader.callback)
+        reg.reader.dispatcher->InvokeAsync(reg.reader.callback, reg.reader.context, -1);
+
+    if (reg.writer.callback)
+        reg.writer.dispatcher->InvokeAsync(reg.writer.callback, reg.writer.context, -1);
+
+    reg = SocketRegistration();
 }
+
+void SocketWaiter::PollEpoll(int timeout)
+{
+    int wakeHandle = wakeEvent.handle();
+
+    int count = epoll_wait(epollHandle, epollEvents.data(), (int)epollEvents.size(), timeout);
+    if (count == Socket::SocketError)
+    {
+        if (errno != EINTR)
+            Console::WriteLine("failed to wait for socket events: %", (int)errno);
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(mut);
+
+    for (int i = 0; i < count; ++i)
+    {
+        int socket = epollEvents[i].data.fd;
+        auto revents = epollEvents[i].events;
+
+        if (socket == wakeHandle) {
+            wakeEvent.Reset();
+            continue;
+        }
+
+        // the ring is reaped by Poll()
+        if (socket == ring.handle())
+            continue;
+
+        // the socket may have been removed since epoll_wait() returned
+        if ((size_t)socket >= registrations.size() || !registrations[socket].registered)
+            continue;
+
+        // an error is reported by the next operation on the socket
+        auto& reg = registrations[socket];
+        int result = 0;
+
+        if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+            if (reg.reader.callback) {
+                completions.emplace_back(reg.reader, result);
+                reg.reader.callback = nullptr;
+            }
+            else {
+                reg.readable = true;
+            }
+        }
+
+        if (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        {
+            if (reg.writer.callback) {
+                completions.emplace_back(reg.writer, result);
+                reg.writer.callback = nullptr;
+            }
+            else {
+                reg.writable = true;
+            }
+        }
+    }
+}
+
+#else
+
+bool SocketWaiter::WaitEpoll(const SocketWaitInfo& info) { return false; }
+void SocketWaiter::RemoveEpoll(int socket) {}
+void SocketWaiter::PollEpoll(int timeout) {}
+
+#endif
@@ -11,7 +11,9 @@
 #include <cstdint>
 #include <net/sockets/Socket.h>
 #include <net/sockets/OSSockets.h>
+#include <net/sockets/SocketRing.h>
 #include <system/Dispatcher.h>
+#include <system/WakeEvent.h>
 #include <experimental/coroutine>
 #include <functional>
 #include <memory>
@@ -25,6 +27,17 @@ enum class SocketOperationType
     Recv,
 };
 
+enum class SocketWaiterBackend
+{
+    Poll,
+    Epoll,
+#ifdef __linux__
+    Default = Epoll
+#else
+    Default = Poll
+#endif
+};
+
 struct SocketWaitInfo
 {
     SocketOperationType type;
@@ -34,24 +47,56 @@ struct SocketWaitInfo
     Dispatcher* dispatcher;
 };
 
-class SocketWaiter
+// epoll backend: sockets stay registered (edge-triggered) until they are removed,
+// so a wait only has to fill in the reader or writer slot for the socket.
+struct SocketRegistration
+{
+    SocketWaitInfo reader{}; // Accept, Recv
+    SocketWaitInfo writer{}; // Connect, Send
+    bool registered = false;
+    bool readable = false;   // an edge arrived while no reader was waiting
+    bool writable = false;   // an edge arrived while no writer was waiting
+};
+
+// A reactor owned by a single dispatcher thread. Waits are registered from the
+// owning thread, and the dispatcher polls for readiness inline whenever its run
+// queue is empty, so completions never leave the thread that started them.
+// The thread's io_uring ring is polled and reaped here too, once it's opened.
+class SocketWaiter : public DispatchPoller
 {
-    static constexpr int RequestWakePort = 32190;
-    static constexpr int SendWakePort = 32191;
-    static constexpr const char* LoopbackAddress = "127.0.0.1";
+    static constexpr int MaxEpollEvents = 256;
 
 public:
-    std::atomic<bool> run = false;
-    std::thread runLoopThread;
-    Socket wakeSockets[2];
+    Dispatcher* dispatcher = nullptr;
+    std::thread::id ownerThread;
+    WakeEvent wakeEvent;
+    SocketWaiterBackend backend = SocketWaiterBackend::Poll;
     std::vector<SocketWaitInfo> sockets;
     std::vector<pollfd> pollfds;
+    std::vector<SocketRegistration> registrations;
+    int epollHandle = -1;
+    std::vector<std::pair<SocketWaitInfo, int>> completions;
+    std::vector<std::pair<SocketWaitInfo, int>> invoking;
+#ifdef __linux__
+    std::vector<epoll_event> epollEvents;
+#endif
     std::mutex mut;
+    SocketRing ring;
+    bool ringFailed = false;
     
-    SocketWaiter();
+    // attaches to the calling thread's dispatcher.
+    // falls back to poll() if 'preferred' is not supported on this platform
+    SocketWaiter(SocketWaiterBackend preferred = SocketWaiterBackend::Default);
     ~SocketWaiter();
+
+    // must be called from the owning thread
+    void Poll(std::chrono::milliseconds timeout) override;
+    void Wake() override;
     
-    // callback: result = 0 for success, result = -1 for failure
+    // callback: result = 0 when the socket is ready, or has an error that the next operation on it
+    //           will report. result = -1 if the wait was cancelled by Remove() or couldn't be started,
+    //           in which case the socket may already be closed, and must not be used.
+    //           invoked on the owning thread, from Poll()
     // dispatcher: must not be null
     // context: optional context pointer returned in callback
     bool Wait(
@@ -62,9 +107,19 @@ public:
         Dispatcher* dispatcher
     );
 
+    // must be called before 'socket' is closed. Pending waits
+    // on the socket are completed with result = -1. May be called from any thread.
+    void Remove(int socket);
+
+    // the thread's ring, opened on first use, with 'callback' invoked from Poll() for its completions.
+    // Returns null if io_uring isn't available. Must be called from the owning thread.
+    SocketRing* OpenRing(SocketRingCallback callback);
+
 private:
-    void Wake();
-    void RunLoop();
-    void UpdateOperations();
-    void WaitForEvents();
+    void PollSockets(int timeout);
+    void InvokeCompletions();
+
+    bool WaitEpoll(const SocketWaitInfo& info);
+    void RemoveEpoll(int socket);
+    void PollEpoll(int timeout);
 };
@@ -17,15 +17,7 @@ bool DelayAwaiter::ready() {
 
 void DelayAwaiter::suspend(std::experimental::coroutine_handle<> handle)
 {
-    auto resumeTime = DispatchClock::now() + length;
-
-    dispatcher->InvokeAsync(
-        &DelayAwaiter::Callback,
-        handle.address(),
-        0,
-        DispatchPriority::Normal,
-        resumeTime
-    );
+    timer.Start(length, &DelayAwaiter::Callback, handle.address());
 }
 
 void DelayAwaiter::resume()
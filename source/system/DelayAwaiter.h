@@ -17,6 +17,7 @@ struct DelayAwaiter : public Awaiter<void>
 {
     Dispatcher* dispatcher;
     milliseconds length;
+    DispatchTimer timer;
 
     DelayAwaiter() = delete;
     DelayAwaiter(milliseconds length);
@@ -24,8 +25,8 @@ struct DelayAwaiter : public Awaiter<void>
     DelayAwaiter(const DelayAwaiter&) = delete;
     DelayAwaiter& operator=(const DelayAwaiter&) = delete;
 
-    DelayAwaiter(DelayAwaiter&&) = default;
-    DelayAwaiter& operator=(DelayAwaiter&&) = default;
+    DelayAwaiter(DelayAwaiter&&) = delete;
+    DelayAwaiter& operator=(DelayAwaiter&&) = delete;
 
     bool ready() override;
     void suspend(std::experimental::coroutine_handle<> handle) override;
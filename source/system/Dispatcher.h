@@ -17,8 +17,12 @@
 #include <functional>
 #include <cassert>
 #include <chrono>
+#include <algorithm>
 #include <system/PriorityQueue.h>
 #include <system/Console.h>
+#include <system/MemoryPool.h>
+#include <system/WakeEvent.h>
+#include <system/TimingWheel.h>
 
 using DispatchClock = std::chrono::steady_clock;
 using DispatchTime = std::chrono::steady_clock::time_point;
@@ -40,6 +44,14 @@ struct DispatchAction
     DispatchPriority pri = DispatchPriority::Normal;
     DispatchTime tim = DispatchTime(std::chrono::microseconds(0));
     void(*fin)(void* ptr, intmax_t num) = nullptr;
+    std::atomic<DispatchAction*> next = nullptr; // intrusive link for DispatchQueueMode::LockFree
+    TimerNode timer;                             // used while waiting for 'tim'
+
+    DispatchAction() = default;
+
+    DispatchAction(void(*fun)(void* ptr, intmax_t num), void* ptr, intmax_t num,
+                   DispatchPriority pri, DispatchTime tim, void(*fin)(void* ptr, intmax_t num))
+        : fun(fun), ptr(ptr), num(num), pri(pri), tim(tim), fin(fin) {}
 
     bool operator==(const DispatchAction& right) const { return pri == right.pri; }
     bool operator!=(const DispatchAction& right) const { return pri != right.pri; }
@@ -49,19 +61,96 @@ struct DispatchAction
     bool operator>=(const DispatchAction& right) { return pri >= right.pri; }
 };
 
+enum class DispatchQueueMode
+{
+    // all requests go through a mutex protected priority queue
+    Locked,
+
+    // requests from other threads go through an intrusive lock-free MPSC queue,
+    // and requests from the dispatcher's own thread through an unsynchronized one.
+    // Requests run in the order they were posted, regardless of priority.
+    LockFree,
+
+    Default = LockFree
+};
+
+struct DispatchHandler
+{
+    void(*fun)(void* ptr) = nullptr;
+    void* ptr = nullptr;
+};
+
+///<summary>
+///Blocks on behalf of an idle Dispatcher, so that another event source
+///(e.g. socket readiness) can be serviced inline on the dispatcher's thread.
+///</summary>
+class DispatchPoller
+{
+public:
+    virtual ~DispatchPoller() {}
+
+    // handle pending events, blocking for at most 'timeout' (forever if negative)
+    // or until Wake() is called. Called on the dispatcher's thread.
+    virtual void Poll(std::chrono::milliseconds timeout) = 0;
+
+    // makes a blocked Poll() return. May be called from any thread.
+    // Implementations can use a WakeEvent for this.
+    virtual void Wake() = 0;
+};
+
+class DispatchTimer;
+
 class Dispatcher
 {
+    friend class DispatchTimer;
+
+    // a dispatcher with a poller also polls it without blocking after this many
+    // consecutive requests, so events can't be starved by a busy run queue
+    static constexpr int MaxRequestsPerPoll = 64;
+
     mutable std::mutex mut;
     mutable std::condition_variable cv;
     std::atomic<bool> run = false;
     PriorityQueue<DispatchAction*> requests;
+    std::vector<DispatchHandler> idleHandlers;
+    std::vector<DispatchHandler> iterationHandlers;
+    std::atomic<DispatchPoller*> poller = nullptr;
+    bool polling = false;
+    uint64_t invocationCount = 0;
+    std::atomic<int64_t> waitTime = 0;  // nanoseconds spent blocked, only written by the owning thread
+    std::atomic<int64_t> waitStart = 0; // clock ticks of the current wait, or zero
+    TimingWheel timers; // only used on the dispatcher's own thread
+
+    // DispatchQueueMode::LockFree
+    DispatchQueueMode mode;
+    std::thread::id ownerThread;
+    DispatchAction remoteStub;
+    DispatchAction* remoteHead = &remoteStub;          // consumer end
+    std::atomic<DispatchAction*> remoteTail = &remoteStub; // producer end
+    DispatchAction* localHead = nullptr;
+    DispatchAction* localTail = nullptr;
+    std::atomic<bool> parked = false;
+    std::unique_ptr<WakeEvent> wakeEvent;
+
+    static inline std::atomic<DispatchQueueMode> defaultMode = DispatchQueueMode::Default;
 
     void InvokeAsync(DispatchAction* req)
     {
+        if (mode == DispatchQueueMode::LockFree) {
+            PostLockFree(req);
+            return;
+        }
+
+        if (std::this_thread::get_id() == ownerThread && IsDelayed(req)) {
+            ScheduleAction(req);
+            return;
+        }
+
+        // delayed requests from other threads are moved to the timing wheel by WaitForRequest()
         std::unique_lock<std::mutex> lk(mut);
         requests.push(req);
 
-        if (run && req->tim <= DispatchClock::now())
+        if (run)
             Wake();
     }
 
@@ -73,7 +162,7 @@ class Dispatcher
                 req->fun(req->ptr, req->num);
         }
         catch (std::exception& ex) {
-            Console::WriteLine("Dispatcher: error invoking finalizer - ", ex.what());
+            Console::WriteLine("Dispatcher: error invoking function - %", ex.what());
         }
     }
 
@@ -85,7 +174,7 @@ class Dispatcher
                 req->fin(req->ptr, req->num);
         }
         catch (std::exception& ex) {
-            Console::WriteLine("Dispatcher: error invoking finalizer - ", ex.what());
+            Console::WriteLine("Dispatcher: error invoking finalizer - %", ex.what());
         }
     }
 
@@ -97,12 +186,45 @@ public:
     }
 
     Dispatcher()
+        : mode(defaultMode), ownerThread(std::this_thread::get_id())
     {
+        if (mode == DispatchQueueMode::LockFree)
+            wakeEvent = std::make_unique<WakeEvent>();
     }
 
-    ~Dispatcher() {
-        requests.unordered_enumerate([](DispatchAction* req) { delete req; });
+    ~Dispatcher()
+    {
+        requests.unordered_enumerate([](DispatchAction* req) { MemoryPool::Delete(req); });
         requests.clear();
+
+        if (mode == DispatchQueueMode::LockFree)
+        {
+            MoveRemoteRequests();
+
+            for (auto req = localHead; req; ) {
+                auto next = req->next.load(std::memory_order_relaxed);
+                MemoryPool::Delete(req);
+                req = next;
+            }
+
+        }
+
+        timers.Clear([](TimerNode* node) {
+            if (node->fun == &Dispatcher::OnActionTimer)
+                MemoryPool::Delete((DispatchAction*)node->ptr);
+        });
+    }
+
+    ///<summary>
+    ///Sets the queue mode of dispatchers created after this call.
+    ///Dispatchers are created on first use of Dispatcher::current() on each thread.
+    ///</summary>
+    static void SetDefaultQueueMode(DispatchQueueMode mode) {
+        defaultMode = mode;
+    }
+
+    DispatchQueueMode GetQueueMode() const {
+        return mode;
     }
 
     DispatchAction* InvokeAsync(
@@ -114,63 +236,454 @@ public:
         void(*fin)(void* ptr, intmax_t num) = nullptr
     )
     {
-        auto req = new DispatchAction{ function, ptr, num, pri, tim, fin };
+        auto req = MemoryPool::New<DispatchAction>(function, ptr, num, pri, tim, fin);
         InvokeAsync(req);
         return req;
     }
 
-    void Remove(DispatchAction* req)
+    ///<summary>
+    ///'function' is called on this dispatcher's thread each time it runs
+    ///out of ready requests, before it waits for more. Must be called from
+    ///the dispatcher's own thread.
+    ///</summary>
+    void AddIdleHandler(void(*function)(void* ptr), void* ptr)
     {
-        if (req)
-        {
-            if(requests.remove(req))
-                InvokeFinalizer(req);
-        }
+        idleHandlers.push_back(DispatchHandler{ function, ptr });
+    }
+
+    ///<summary>
+    ///'function' is called on this dispatcher's thread after each request
+    ///it invokes, e.g. to pass on work the request queued up without waiting
+    ///for the dispatcher to become idle. Must be called from the dispatcher's
+    ///own thread.
+    ///</summary>
+    void AddIterationHandler(void(*function)(void* ptr), void* ptr)
+    {
+        iterationHandlers.push_back(DispatchHandler{ function, ptr });
+    }
+
+    ///<summary>
+    ///While this dispatcher is idle, it blocks in 'poller' instead of waiting
+    ///on its condition variable. Pass null to remove it. Must be called from
+    ///the dispatcher's own thread.
+    ///</summary>
+    void SetPoller(DispatchPoller* poller)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        this->poller = poller;
+    }
+
+    DispatchPoller* GetPoller() const {
+        return poller;
+    }
+
+    // number of requests this dispatcher has started invoking.
+    // Only meaningful on the dispatcher's own thread.
+    uint64_t GetInvocationCount() const {
+        return invocationCount;
+    }
+
+    ///<summary>
+    ///Total time this dispatcher has spent blocked waiting for requests, including
+    ///the current wait. May be called from any thread, e.g. to measure how busy the
+    ///dispatcher is, in which case it may be off by one wait until the next call.
+    ///</summary>
+    std::chrono::nanoseconds GetWaitTime() const
+    {
+        auto total = waitTime.load(std::memory_order_relaxed);
+        auto start = waitStart.load(std::memory_order_relaxed);
+
+        if (start != 0)
+            total += std::max<int64_t>(GetClockTicks() - start, 0);
+
+        return std::chrono::nanoseconds(total);
     }
 
     void Run()
     {
         run = true;
+        int requestsSincePoll = 0;
 
         while (run)
         {
+            RunExpiredTimers();
+
+            if (!idleHandlers.empty() && !HasReadyRequest())
+                InvokeHandlers(idleHandlers, "idle");
+
+            if (poller && ++requestsSincePoll > MaxRequestsPerPoll) {
+                poller.load()->Poll(std::chrono::milliseconds(0));
+                requestsSincePoll = 0;
+            }
+
             auto req = WaitForRequest();
 
             if (run && req) {
+                ++invocationCount;
                 InvokeFunction(req.get());
                 InvokeFinalizer(req.get());
+
+                if (!iterationHandlers.empty())
+                    InvokeHandlers(iterationHandlers, "iteration");
             }
         }
     }
 
     void Quit()
     {
+        if (mode == DispatchQueueMode::LockFree) {
+            run = false;
+            Unpark();
+            return;
+        }
+
         std::unique_lock<std::mutex> lk(mut);
         run = false;
         Wake();
     }
 
 private:
-    void Wake() {
-        cv.notify_one();
+    // mut must be held
+    void Wake()
+    {
+        if (poller) {
+            // one wake per Poll() is enough
+            if (polling) {
+                polling = false;
+                poller.load()->Wake();
+            }
+        }
+        else {
+            cv.notify_one();
+        }
+    }
+
+    bool HasReadyRequest() const
+    {
+        if (mode == DispatchQueueMode::LockFree)
+            return localHead || remoteTail.load() != &remoteStub;
+
+        std::unique_lock<std::mutex> lk(mut);
+        return !requests.empty();
+    }
+
+    void InvokeHandlers(const std::vector<DispatchHandler>& handlers, const char* kind)
+    {
+        for (auto& handler : handlers)
+        {
+            try {
+                handler.fun(handler.ptr);
+            }
+            catch (std::exception& ex) {
+                Console::WriteLine("Dispatcher: error invoking % handler - %", kind, ex.what());
+            }
+        }
     }
 
-    std::unique_ptr<DispatchAction> WaitForRequest()
+    MemoryPool::Ptr<DispatchAction> WaitForRequest()
     {
+        if (mode == DispatchQueueMode::LockFree)
+            return WaitForRequestLockFree();
+
+        auto timeout = timers.GetTimeout(DispatchClock::now());
+
         std::unique_lock<std::mutex> lk(mut);
         
-        if (!requests.empty() && requests.top()->tim > DispatchClock::now())
-            cv.wait_until(lk, requests.top()->tim, [this]{ return !run || (!requests.empty() && requests.top()->tim <= DispatchClock::now()); });
-        else
-            cv.wait(lk, [this] { return !run || !requests.empty(); });
+        if (run && requests.empty())
+        {
+            BeginWait();
+
+            if (auto p = poller.load())
+            {
+                // InvokeAsync() and Quit() only wake the poller while 'polling' is set,
+                // and they set it under 'mut', so a request queued after the check above
+                // will either be seen by the caller's next check or interrupt Poll().
+                polling = true;
+                lk.unlock();
+                p->Poll(timeout);
+                lk.lock();
+                polling = false;
+            }
+            else if (timeout.count() >= 0)
+                cv.wait_for(lk, timeout, [this] { return !run || !requests.empty(); });
+            else
+                cv.wait(lk, [this] { return !run || !requests.empty(); });
+
+            EndWait();
+        }
         
-        std::unique_ptr<DispatchAction> req;
+        MemoryPool::Ptr<DispatchAction> req;
 
         if (run && !requests.empty()) {
             req.reset(requests.top());
             requests.pop();
         }
 
+        lk.unlock();
+
+        if (req && IsDelayed(req.get())) {
+            ScheduleAction(req.release());
+            return nullptr;
+        }
+
+        return req;
+    }
+
+    // Wait time
+
+    static int64_t GetClockTicks() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(DispatchClock::now().time_since_epoch()).count();
+    }
+
+    void BeginWait() {
+        waitStart.store(GetClockTicks(), std::memory_order_relaxed);
+    }
+
+    void EndWait()
+    {
+        auto waited = GetClockTicks() - waitStart.load(std::memory_order_relaxed);
+        waitStart.store(0, std::memory_order_relaxed);
+        waitTime.store(waitTime.load(std::memory_order_relaxed) + waited, std::memory_order_relaxed);
+    }
+
+    // Timers
+
+    static bool IsDelayed(DispatchAction* req) {
+        return req->tim > DispatchTime() && req->tim > DispatchClock::now();
+    }
+
+    // must be called on the dispatcher's own thread
+    void ScheduleAction(DispatchAction* req)
+    {
+        req->timer.fun = &Dispatcher::OnActionTimer;
+        req->timer.ptr = req;
+        timers.Insert(&req->timer, req->tim);
+    }
+
+    // moves an action whose time has come to the run queue
+    static void OnActionTimer(void* ptr, intmax_t)
+    {
+        auto req = (DispatchAction*)ptr;
+        auto& self = Dispatcher::current();
+
+        if (self.mode == DispatchQueueMode::LockFree) {
+            self.PushLocal(req);
+        }
+        else {
+            std::unique_lock<std::mutex> lk(self.mut);
+            self.requests.push(req);
+        }
+    }
+
+    void RunExpiredTimers()
+    {
+        if (timers.empty())
+            return;
+
+        timers.Advance(DispatchClock::now());
+
+        while (auto node = timers.PopExpired())
+        {
+            try
+            {
+                if (node->fun != &Dispatcher::OnActionTimer)
+                    ++invocationCount;
+
+                node->fun(node->ptr, node->num);
+            }
+            catch (std::exception& ex) {
+                Console::WriteLine("Dispatcher: error invoking timer - %", ex.what());
+            }
+        }
+    }
+
+    // LockFree mode
+
+    void PostLockFree(DispatchAction* req)
+    {
+        if (std::this_thread::get_id() == ownerThread)
+        {
+            // the owning thread isn't parked while it's posting
+            if (IsDelayed(req))
+                ScheduleAction(req);
+            else
+                PushLocal(req);
+
+            return;
+        }
+
+        // Vyukov's intrusive MPSC queue: producers only contend on one exchange
+        req->next.store(nullptr, std::memory_order_relaxed);
+        auto prev = remoteTail.exchange(req);
+        prev->next.store(req, std::memory_order_release);
+
+        // pairs with the store to 'parked' in Park(). Both are seq_cst, so either the
+        // consumer sees this request before parking, or this sees 'parked' and wakes it.
+        if (parked.load() && parked.exchange(false))
+            Unpark();
+    }
+
+    void PushLocal(DispatchAction* req)
+    {
+        req->next.store(nullptr, std::memory_order_relaxed);
+
+        if (localTail)
+            localTail->next.store(req, std::memory_order_relaxed);
+        else
+            localHead = req;
+
+        localTail = req;
+    }
+
+    DispatchAction* PopLocal()
+    {
+        auto req = localHead;
+        if (req)
+        {
+            localHead = req->next.load(std::memory_order_relaxed);
+            if (!localHead)
+                localTail = nullptr;
+        }
         return req;
     }
+
+    DispatchAction* PopRemote()
+    {
+        auto head = remoteHead;
+        auto next = head->next.load(std::memory_order_acquire);
+
+        if (head == &remoteStub)
+        {
+            if (!next)
+                return nullptr;
+
+            remoteHead = next;
+            head = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            remoteHead = next;
+            return head;
+        }
+
+        // a producer has swapped the tail but not linked its request yet
+        if (head != remoteTail.load())
+            return nullptr;
+
+        remoteStub.next.store(nullptr, std::memory_order_relaxed);
+        auto prev = remoteTail.exchange(&remoteStub);
+        prev->next.store(&remoteStub, std::memory_order_release);
+
+        next = head->next.load(std::memory_order_acquire);
+        if (next) {
+            remoteHead = next;
+            return head;
+        }
+
+        return nullptr;
+    }
+
+    void MoveRemoteRequests()
+    {
+        while (auto req = PopRemote())
+        {
+            if (IsDelayed(req))
+                ScheduleAction(req);
+            else
+                PushLocal(req);
+        }
+    }
+
+    MemoryPool::Ptr<DispatchAction> WaitForRequestLockFree()
+    {
+        MoveRemoteRequests();
+
+        if (auto req = PopLocal())
+            return MemoryPool::Ptr<DispatchAction>(req);
+
+        Park(timers.GetTimeout(DispatchClock::now()));
+
+        MoveRemoteRequests();
+        return MemoryPool::Ptr<DispatchAction>(PopLocal());
+    }
+
+    void Park(std::chrono::milliseconds timeout)
+    {
+        parked = true;
+
+        // a request that's mid-push counts as pending, so this never parks on it
+        if (!run || remoteTail.load() != &remoteStub) {
+            parked = false;
+            return;
+        }
+
+        BeginWait();
+
+        if (auto p = poller.load()) {
+            p->Poll(timeout);
+        }
+        else {
+            wakeEvent->Wait(timeout);
+            wakeEvent->Reset();
+        }
+
+        EndWait();
+        parked = false;
+    }
+
+    void Unpark()
+    {
+        if (auto p = poller.load())
+            p->Wake();
+        else
+            wakeEvent->Signal();
+    }
+};
+
+///<summary>
+///A one-shot timer that can be started, restarted and cancelled in O(1) without allocating,
+///e.g. for timeouts that are re-armed on every request. It must only be used on the thread
+///of the dispatcher it was started on. The destructor cancels it.
+///</summary>
+class DispatchTimer : private TimerNode
+{
+    Dispatcher* dispatcher = nullptr;
+
+public:
+    DispatchTimer() = default;
+
+    DispatchTimer(const DispatchTimer&) = delete;
+    DispatchTimer& operator=(const DispatchTimer&) = delete;
+
+    ~DispatchTimer() {
+        Cancel();
+    }
+
+    // 'function' is called on the current thread's dispatcher at 'deadline', unless cancelled first
+    void Start(DispatchTime deadline, void(*function)(void* ptr, intmax_t num), void* ptr = nullptr, intmax_t num = 0)
+    {
+        Cancel();
+
+        this->fun = function;
+        this->ptr = ptr;
+        this->num = num;
+
+        dispatcher = &Dispatcher::current();
+        dispatcher->timers.Insert(this, deadline);
+    }
+
+    void Start(std::chrono::milliseconds delay, void(*function)(void* ptr, intmax_t num), void* ptr = nullptr, intmax_t num = 0) {
+        Start(DispatchClock::now() + delay, function, ptr, num);
+    }
+
+    void Cancel()
+    {
+        if (dispatcher && linked())
+            dispatcher->timers.Remove(this);
+    }
+
+    bool IsActive() const {
+        return linked();
+    }
 };
@@ -0,0 +1,157 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <system/File.h>
+#include <algorithm>
+#include <climits>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+File::~File() {
+    Close();
+}
+
+File::File(File&& file) noexcept
+    : _handle(file._handle), _regular(file._regular), _size(file._size),
+      _modified(file._modified), _inode(file._inode)
+{
+    file._handle = -1;
+}
+
+File& File::operator=(File&& file) noexcept
+{
+    if (this != &file)
+    {
+        Close();
+        _handle = file._handle;
+        _regular = file._regular;
+        _size = file._size;
+        _modified = file._modified;
+        _inode = file._inode;
+        file._handle = -1;
+    }
+
+    return *this;
+}
+
+bool File::Open(const std::string& path)
+{
+    Close();
+
+#ifdef _WIN32
+    _handle = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+    if (_handle == -1)
+        return false;
+
+    struct _stat64 info;
+    if (_fstat64(_handle, &info) == -1) {
+        Close();
+        return false;
+    }
+
+    _regular = (info.st_mode & _S_IFMT) == _S_IFREG;
+    _inode = 0; // not meaningful on Windows
+#else
+    // O_NONBLOCK keeps a FIFO from blocking the open. It has no effect on regular files.
+    _handle = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (_handle == -1)
+        return false;
+
+    struct stat info;
+    if (fstat(_handle, &info) == -1) {
+        Close();
+        return false;
+    }
+
+    _regular = S_ISREG(info.st_mode);
+    _inode = (uint64_t)info.st_ino;
+#endif
+
+    _size = _regular ? (int64_t)info.st_size : 0;
+    _modified = (int64_t)info.st_mtime;
+    return true;
+}
+
+void File::Close()
+{
+    if (_handle != -1)
+    {
+#ifdef _WIN32
+        _close(_handle);
+#else
+        close(_handle);
+#endif
+        _handle = -1;
+        _regular = false;
+        _size = 0;
+        _modified = 0;
+        _inode = 0;
+    }
+}
+
+int File::handle() const {
+    return _handle;
+}
+
+bool File::valid() const {
+    return _handle != -1;
+}
+
+bool File::regular() const {
+    return _regular;
+}
+
+int64_t File::size() const {
+    return _size;
+}
+
+int64_t File::modified() const {
+    return _modified;
+}
+
+bool File::Unchanged(const std::string& path) const
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) == -1 || (info.st_mode & _S_IFMT) != _S_IFREG)
+        return false;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) == -1 || !S_ISREG(info.st_mode) || (uint64_t)info.st_ino != _inode)
+        return false;
+#endif
+
+    return _regular && (int64_t)info.st_size == _size && (int64_t)info.st_mtime == _modified;
+}
+
+bool File::IsDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    return _stat64(path.c_str(), &info) == 0 && (info.st_mode & _S_IFMT) == _S_IFDIR;
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+int64_t File::Read(char* buffer, size_t count, int64_t offset) const
+{
+#ifdef _WIN32
+    if (_lseeki64(_handle, offset, SEEK_SET) == -1)
+        return -1;
+
+    return _read(_handle, buffer, (unsigned int)std::min(count, (size_t)INT_MAX));
+#else
+    return pread(_handle, buffer, count, (off_t)offset);
+#endif
+}
@@ -0,0 +1,58 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <string>
+#include <cstdint>
+
+///<summary>
+///A file opened read-only by its OS handle, for code that needs the handle itself,
+///e.g. to pass it to sendfile(). Reads are positional, so one File can be read
+///at several offsets without seeking.
+///</summary>
+class File
+{
+    int _handle = -1;
+    bool _regular = false;
+    int64_t _size = 0;
+    int64_t _modified = 0;
+    uint64_t _inode = 0;
+
+public:
+    File() = default;
+    ~File();
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    File(File&& file) noexcept;
+    File& operator=(File&& file) noexcept;
+
+    // returns false if the file can't be opened
+    bool Open(const std::string& path);
+    void Close();
+
+    int handle() const;
+    bool valid() const;
+
+    // false for directories, pipes, devices, etc.
+    bool regular() const;
+
+    // only meaningful for regular files
+    int64_t size() const;
+
+    // the last modification time, in seconds since 1970
+    int64_t modified() const;
+
+    // true if 'path' still names a regular file with the same size and modification time
+    // (and on POSIX, the same inode), so it's most likely the file that was opened
+    bool Unchanged(const std::string& path) const;
+
+    // true if 'path' names a directory
+    static bool IsDirectory(const std::string& path);
+
+    // reads up to 'count' bytes at 'offset'. Returns the number of bytes read, 0 at the end of the file, or -1 on error
+    int64_t Read(char* buffer, size_t count, int64_t offset) const;
+};
@@ -0,0 +1,101 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <system/MemoryPool.h>
+
+namespace
+{
+    constexpr size_t SizeClassCount = MemoryPool::MaxBlockSize / MemoryPool::SizeClassStep;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // other thread_locals may still allocate or free after this thread's
+    // lists are gone, so those calls go straight to the heap
+    thread_local bool destroyed = false;
+
+    struct FreeLists
+    {
+        FreeBlock* heads[SizeClassCount] = {};
+        size_t counts[SizeClassCount] = {};
+
+        ~FreeLists()
+        {
+            destroyed = true;
+
+            for (auto head : heads)
+            {
+                while (head) {
+                    auto next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    thread_local FreeLists freeLists;
+
+    size_t GetSizeClass(size_t size) {
+        return (size + MemoryPool::SizeClassStep - 1) / MemoryPool::SizeClassStep - 1;
+    }
+}
+
+std::atomic<uint64_t> MemoryPool::allocationCount = 0;
+
+void* MemoryPool::Allocate(size_t size)
+{
+    if (size == 0)
+        size = 1;
+
+    if (size <= MaxBlockSize)
+    {
+        auto sizeClass = GetSizeClass(size);
+
+        if (!destroyed && freeLists.heads[sizeClass])
+        {
+            auto block = freeLists.heads[sizeClass];
+            freeLists.heads[sizeClass] = block->next;
+            --freeLists.counts[sizeClass];
+            return block;
+        }
+
+        // every block in a class is the same size, so it can be reused for any request in that class
+        size = (sizeClass + 1) * SizeClassStep;
+    }
+
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}
+
+void MemoryPool::Free(void* block, size_t size)
+{
+    if (!block)
+        return;
+
+    if (size == 0)
+        size = 1;
+
+    if (size <= MaxBlockSize && !destroyed)
+    {
+        auto sizeClass = GetSizeClass(size);
+
+        if (freeLists.counts[sizeClass] < MaxCachedBlocks)
+        {
+            auto freeBlock = (FreeBlock*)block;
+            freeBlock->next = freeLists.heads[sizeClass];
+            freeLists.heads[sizeClass] = freeBlock;
+            ++freeLists.counts[sizeClass];
+            return;
+        }
+    }
+
+    ::operator delete(block);
+}
+
+uint64_t MemoryPool::GetAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,99 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+
+///<summary>
+///Per-thread freelists of small memory blocks, grouped into size classes.
+///Blocks may be freed on a different thread than the one that allocated them;
+///they are simply cached by the thread that frees them.
+///</summary>
+class MemoryPool
+{
+public:
+    static constexpr size_t SizeClassStep = 32;
+    static constexpr size_t MaxBlockSize = 4096; // coroutine frames of the request handlers are over 1 KB
+    static constexpr size_t MaxCachedBlocks = 1024; // per size class, per thread
+
+    static void* Allocate(size_t size);
+    static void Free(void* block, size_t size);
+
+    // number of blocks the pool has requested from the heap, on all threads.
+    // Stops increasing once the pool has warmed up to a steady workload.
+    static uint64_t GetAllocationCount();
+
+    template<class T, class... Args>
+    static T* New(Args&&... args)
+    {
+        void* block = Allocate(sizeof(T));
+        try {
+            return new (block) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            Free(block, sizeof(T));
+            throw;
+        }
+    }
+
+    template<class T>
+    static void Delete(T* object)
+    {
+        if (object) {
+            object->~T();
+            Free(object, sizeof(T));
+        }
+    }
+
+    template<class T>
+    struct Deleter
+    {
+        void operator()(T* object) const {
+            Delete(object);
+        }
+    };
+
+    template<class T>
+    using Ptr = std::unique_ptr<T, Deleter<T>>;
+
+private:
+    static std::atomic<uint64_t> allocationCount;
+};
+
+// allows pooled std::allocate_shared
+template<class T>
+struct PoolAllocator
+{
+    typedef T value_type;
+
+    PoolAllocator() = default;
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return (T*)MemoryPool::Allocate(sizeof(T) * count);
+    }
+
+    void deallocate(T* block, size_t count) {
+        MemoryPool::Free(block, sizeof(T) * count);
+    }
+
+    template<class U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+
+    template<class U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+template<class T, class... Args>
+std::shared_ptr<T> MakePooled(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
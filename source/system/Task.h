@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <memory>
 #include <system/Awaiter.h>
+#include <system/MemoryPool.h>
 #include <system/DelayAwaiter.h>
 
 template<class T>
@@ -42,7 +43,7 @@ public:
 
 public:
     static Task<void> Delay(milliseconds length) {
-        return Task<void>(std::make_shared<DelayAwaiter>(length));
+        return Task<void>(MakePooled<DelayAwaiter>(length));
     }
 
 private:
@@ -105,10 +106,19 @@ namespace std::experimental
             {
                 auto dispatcher = &Dispatcher::current();
                 auto myHandle = coroutine_handle<>::from_address(coroutine_handle<promise_type>::from_promise(*this).address());
-                awaiter = std::make_shared<CoroutineAwaiter<T>>(dispatcher, myHandle);
+                awaiter = MakePooled<CoroutineAwaiter<T>>(dispatcher, myHandle);
                 return Task<T>(awaiter);
             }
 
+            // small coroutine frames are recycled through the pool
+            static void* operator new(size_t size) {
+                return MemoryPool::Allocate(size);
+            }
+
+            static void operator delete(void* frame, size_t size) {
+                MemoryPool::Free(frame, size);
+            }
+
             auto initial_suspend() const {
                 return std::experimental::suspend_never{};
             }
@@ -160,10 +170,19 @@ namespace std::experimental
             {
                 auto dispatcher = &Dispatcher::current();
                 auto myHandle = coroutine_handle<>::from_address(coroutine_handle<promise_type>::from_promise(*this).address());
-                awaiter = std::make_shared<CoroutineAwaiter<void>>(dispatcher, myHandle);
+                awaiter = MakePooled<CoroutineAwaiter<void>>(dispatcher, myHandle);
                 return Task<void>(awaiter);
             }
 
+            // small coroutine frames are recycled through the pool
+            static void* operator new(size_t size) {
+                return MemoryPool::Allocate(size);
+            }
+
+            static void operator delete(void* frame, size_t size) {
+                MemoryPool::Free(frame, size);
+            }
+
             auto initial_suspend() const {
                 return std::experimental::suspend_never{};
             }
@@ -0,0 +1,179 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <system/TimingWheel.h>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+
+using namespace std::chrono;
+
+TimingWheel::TimingWheel()
+    : origin(Clock::now())
+{
+}
+
+uint64_t TimingWheel::GetTick(Clock::time_point time, bool roundUp) const
+{
+    if (time <= origin)
+        return 0;
+
+    auto ticks = roundUp ? ceil<milliseconds>(time - origin) : floor<milliseconds>(time - origin);
+    return (uint64_t)ticks.count();
+}
+
+void TimingWheel::Insert(TimerNode* node, Clock::time_point deadline)
+{
+    // rounded up, so timers never fire early
+    node->expiry = GetTick(deadline, true);
+    ++count;
+    Place(node);
+}
+
+void TimingWheel::Remove(TimerNode* node)
+{
+    if (!node->linked())
+        return;
+
+    if (node->level >= 0)
+        --levelCounts[node->level];
+
+    node->unlink();
+    --count;
+}
+
+void TimingWheel::Place(TimerNode* node)
+{
+    if (node->expiry <= current) {
+        node->level = -1;
+        expired.insert(node);
+        return;
+    }
+
+    uint64_t delta = node->expiry - current;
+    uint64_t maxDelta = ((uint64_t)1 << (SlotBits * LevelCount)) - 1;
+
+    // too far out for the wheel: park it in the farthest slot, and it will be placed again when that cascades
+    if (delta > maxDelta)
+        delta = maxDelta;
+
+    int level = 0;
+    while (level < LevelCount - 1 && delta >= ((uint64_t)1 << (SlotBits * (level + 1))))
+        ++level;
+
+    uint64_t tick = std::min(node->expiry, current + delta);
+    auto slot = (tick >> (SlotBits * level)) & SlotMask;
+
+    node->level = level;
+    ++levelCounts[level];
+    slots[level][slot].insert(node);
+}
+
+void TimingWheel::Cascade(int level)
+{
+    auto slot = (current >> (SlotBits * level)) & SlotMask;
+
+    // higher levels first, so their timers can still land in this level's current slot
+    if (slot == 0 && level + 1 < LevelCount)
+        Cascade(level + 1);
+
+    auto& head = slots[level][slot];
+
+    while (head.linked())
+    {
+        auto node = (TimerNode*)head.next;
+        node->unlink();
+        --levelCounts[level];
+        Place(node);
+    }
+}
+
+void TimingWheel::Advance(Clock::time_point now)
+{
+    uint64_t target = GetTick(now, false);
+
+    bool idle = std::all_of(std::begin(levelCounts), std::end(levelCounts), [](size_t n) { return n == 0; });
+    if (idle) {
+        current = std::max(current, target);
+        return;
+    }
+
+    while (current < target)
+    {
+        // nothing can expire before level 0 wraps around, so skip ahead
+        if (levelCounts[0] == 0)
+        {
+            uint64_t boundary = (current | SlotMask) + 1;
+            if (boundary > target) {
+                current = target;
+                break;
+            }
+
+            current = boundary - 1;
+        }
+
+        ++current;
+
+        if ((current & SlotMask) == 0)
+            Cascade(1);
+
+        auto& head = slots[0][current & SlotMask];
+
+        while (head.linked())
+        {
+            auto node = (TimerNode*)head.next;
+            node->unlink();
+            --levelCounts[0];
+            node->level = -1;
+            expired.insert(node);
+        }
+    }
+}
+
+TimerNode* TimingWheel::PopExpired()
+{
+    if (!expired.linked())
+        return nullptr;
+
+    auto node = (TimerNode*)expired.next;
+    node->unlink();
+    --count;
+    return node;
+}
+
+milliseconds TimingWheel::GetTimeout(Clock::time_point now) const
+{
+    if (count == 0)
+        return milliseconds(-1);
+
+    if (expired.linked())
+        return milliseconds(0);
+
+    // the earliest tick at which a non-empty slot expires (level 0) or cascades (higher levels)
+    uint64_t next = UINT64_MAX;
+
+    for (int level = 0; level < LevelCount; ++level)
+    {
+        if (levelCounts[level] == 0)
+            continue;
+
+        int shift = SlotBits * level;
+        uint64_t base = current >> shift;
+
+        for (uint64_t i = 1; i <= SlotCount; ++i)
+        {
+            if (slots[level][(base + i) & SlotMask].linked()) {
+                next = std::min(next, (base + i) << shift);
+                break;
+            }
+        }
+    }
+
+    auto deadline = origin + milliseconds(next);
+    if (deadline <= now)
+        return milliseconds(0);
+
+    return ceil<milliseconds>(deadline - now);
+}
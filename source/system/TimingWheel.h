@@ -0,0 +1,112 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <cstdint>
+#include <chrono>
+
+struct TimerLink
+{
+    TimerLink* prev = this;
+    TimerLink* next = this;
+
+    bool linked() const { return next != this; }
+
+    void unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = this;
+    }
+
+    // inserts 'link' before this one. For a list head, that's at the back.
+    void insert(TimerLink* link)
+    {
+        link->prev = prev;
+        link->next = this;
+        prev->next = link;
+        prev = link;
+    }
+};
+
+struct TimerNode : TimerLink
+{
+    void(*fun)(void* ptr, intmax_t num) = nullptr;
+    void* ptr = nullptr;
+    intmax_t num = 0;
+    uint64_t expiry = 0;  // tick
+    int level = -1;       // -1 when in the expired list
+};
+
+///<summary>
+///Hierarchical timing wheel with millisecond ticks (4 levels of 256 slots, ~49 days).
+///Insert, Remove and per-tick expiry are O(1). Not thread safe.
+///</summary>
+class TimingWheel
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr int SlotBits = 8;
+    static constexpr int SlotCount = 1 << SlotBits;
+    static constexpr uint64_t SlotMask = SlotCount - 1;
+    static constexpr int LevelCount = 4;
+
+    TimingWheel();
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // 'node' must not already be in the wheel
+    void Insert(TimerNode* node, Clock::time_point deadline);
+    void Remove(TimerNode* node);
+
+    // moves every timer due at 'now' to the expired list
+    void Advance(Clock::time_point now);
+
+    // removes and returns the next expired timer, or null
+    TimerNode* PopExpired();
+
+    // time until the next timer might expire, or negative if there are no timers
+    std::chrono::milliseconds GetTimeout(Clock::time_point now) const;
+
+    bool empty() const { return count == 0; }
+
+    // removes every timer, passing each one to 'fn'
+    template<class Fn>
+    void Clear(Fn fn)
+    {
+        auto drain = [&](TimerLink& head) {
+            while (head.linked()) {
+                auto node = (TimerNode*)head.next;
+                node->unlink();
+                fn(node);
+            }
+        };
+
+        for (auto& level : slots) {
+            for (auto& slot : level)
+                drain(slot);
+        }
+
+        drain(expired);
+
+        count = 0;
+        for (auto& levelCount : levelCounts)
+            levelCount = 0;
+    }
+
+private:
+    uint64_t GetTick(Clock::time_point time, bool roundUp) const;
+    void Place(TimerNode* node);
+    void Cascade(int level);
+
+    Clock::time_point origin;
+    uint64_t current = 0;
+    size_t count = 0;                       // including expired timers
+    size_t levelCounts[LevelCount] = {};
+    TimerLink slots[LevelCount][SlotCount];
+    TimerLink expired;
+};
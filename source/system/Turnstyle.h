@@ -8,6 +8,7 @@
 #include <deque>
 #include <mutex>
 #include <atomic>
+#include <algorithm>
 #include <experimental/coroutine>
 #include <system/Dispatcher.h>
 #include <system/Console.h>
@@ -66,6 +67,25 @@ public:
         tokens = 0;
     }
 
+    // resumes the guest waiting on 'dispatcher', if any, without giving it a token
+    void Release(Dispatcher* dispatcher)
+    {
+        std::lock_guard<Spinlock> lk(lock);
+
+        auto it = std::find_if(lineup.begin(), lineup.end(),
+            [dispatcher](const Guest& guest) { return guest.dispatcher == dispatcher; });
+
+        if (it != lineup.end())
+        {
+            it->dispatcher->InvokeAsync(
+                [](auto p, auto) { std::experimental::coroutine_handle<>::from_address(p).resume(); },
+                it->coroutine.address()
+            );
+
+            lineup.erase(it);
+        }
+    }
+
     friend struct TurnstyleAwaiter;
     
     inline bool await_ready()
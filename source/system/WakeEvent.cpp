@@ -0,0 +1,138 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#include <system/WakeEvent.h>
+#include <net/sockets/OSSockets.h>
+#include <stdexcept>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+#ifdef __linux__
+    #include <sys/eventfd.h>
+#endif
+
+WakeEvent::WakeEvent()
+{
+#if defined(__linux__)
+    readHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (readHandle == -1)
+        throw std::runtime_error("failed to create wake event");
+
+    writeHandle = readHandle;
+#elif !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == -1)
+        throw std::runtime_error("failed to create wake event");
+
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    readHandle = fds[0];
+    writeHandle = fds[1];
+#else
+    WSAData wsdata;
+    if (WSAStartup(WINSOCK_VERSION, &wsdata) != 0)
+        throw std::runtime_error("failed to initialze winsock");
+
+    // WSAPoll() only accepts sockets, so pair two over loopback. Binding
+    // to port 0 lets the system pick a free port for each pair.
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    SOCKET writer = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    SOCKET reader = INVALID_SOCKET;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    int len = sizeof(addr);
+
+    bool ok = listener != INVALID_SOCKET && writer != INVALID_SOCKET
+        && bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0
+        && listen(listener, 1) == 0
+        && getsockname(listener, (sockaddr*)&addr, &len) == 0
+        && connect(writer, (sockaddr*)&addr, sizeof(addr)) == 0
+        && (reader = accept(listener, nullptr, nullptr)) != INVALID_SOCKET;
+
+    if (listener != INVALID_SOCKET)
+        closesocket(listener);
+
+    if (!ok)
+    {
+        if (writer != INVALID_SOCKET)
+            closesocket(writer);
+
+        WSACleanup();
+        throw std::runtime_error("failed to create wake event");
+    }
+
+    unsigned long nonBlockingMode = 1;
+    ioctlsocket(reader, FIONBIO, &nonBlockingMode);
+    ioctlsocket(writer, FIONBIO, &nonBlockingMode);
+
+    readHandle = (int)reader;
+    writeHandle = (int)writer;
+#endif
+}
+
+WakeEvent::~WakeEvent()
+{
+    if (writeHandle != readHandle)
+        close(writeHandle);
+
+    close(readHandle);
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void WakeEvent::Signal()
+{
+    if (signaled.exchange(true, std::memory_order_acq_rel))
+        return;
+
+#if defined(__linux__)
+    uint64_t value = 1;
+    (void)write(writeHandle, &value, sizeof(value));
+#elif !defined(_WIN32)
+    char value = 1;
+    (void)write(writeHandle, &value, sizeof(value));
+#else
+    char value = 1;
+    send((SOCKET)writeHandle, &value, sizeof(value), 0);
+#endif
+}
+
+void WakeEvent::Wait(std::chrono::milliseconds timeout)
+{
+    if (signaled.load())
+        return;
+
+    int millis = timeout.count() < 0 ? -1 : (int)std::min<std::chrono::milliseconds::rep>(timeout.count(), INT_MAX);
+
+    pollfd pfd{ (SOCKET)readHandle, POLLIN, 0 };
+    poll(&pfd, 1, millis);
+}
+
+void WakeEvent::Reset()
+{
+#if defined(__linux__)
+    uint64_t value;
+    (void)read(readHandle, &value, sizeof(value));
+#elif !defined(_WIN32)
+    char buffer[64];
+    while (read(readHandle, buffer, sizeof(buffer)) > 0) {}
+#else
+    char buffer[64];
+    while (recv((SOCKET)readHandle, buffer, sizeof(buffer), 0) > 0) {}
+#endif
+
+    // cleared after draining. A Signal() that races with this is skipped,
+    // but the caller checks for signaled work after Reset() returns.
+    signaled.store(false, std::memory_order_seq_cst);
+}
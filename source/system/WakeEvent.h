@@ -0,0 +1,42 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+
+///<summary>
+///A pollable handle that becomes readable when signaled, used to interrupt
+///a thread blocked in poll()/epoll_wait(). Uses an eventfd on Linux, a pipe on
+///other POSIX systems, and a loopback socket pair on an ephemeral port on Windows.
+///Signals are coalesced: only the first Signal() after a Reset() touches the handle.
+///</summary>
+class WakeEvent
+{
+public:
+    WakeEvent();
+    ~WakeEvent();
+
+    WakeEvent(const WakeEvent&) = delete;
+    WakeEvent& operator=(const WakeEvent&) = delete;
+
+    // poll this for readability
+    int handle() const { return readHandle; }
+
+    // may be called from any thread
+    void Signal();
+
+    // blocks until signaled, or for at most 'timeout' (forever if negative).
+    // Doesn't Reset() the event.
+    void Wait(std::chrono::milliseconds timeout);
+
+    // call after handle() polls readable, before checking for the work that was signaled
+    void Reset();
+
+private:
+    std::atomic<bool> signaled = false;
+    int readHandle = -1;
+    int writeHandle = -1;
+};
@@ -0,0 +1,171 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Sends requests to a server over one kept-alive connection, and checks that once it has
+// warmed up, MemoryPool stops allocating, i.e. that socket operations, awaiters and dispatch
+// actions are all recycled. Runs once with each socket engine. Exits with 1 on failure.
+// From this directory, with clang:
+//
+//   clang++ -std=c++17 -fcoroutines-ts -stdlib=libc++ -O2 -I../source KeepAliveAllocationTest.cpp
+//       $(find ../source -name '*.cpp' ! -name main.cpp) -lpthread -o KeepAliveAllocationTest
+
+#include <net/sockets/OSSockets.h>
+#include <net/http/HttpServer.h>
+#include <net/sockets/SocketController.h>
+#include <system/Dispatcher.h>
+#include <system/MemoryPool.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace
+{
+    constexpr int Port = 8189;
+    constexpr int WarmUpRequests = 1000;
+    constexpr int Requests = 20000;
+    constexpr size_t FileSize = 4096;
+
+    string docsPath;
+
+    void Fail(const char* message)
+    {
+        printf("%s\n", message);
+        exit(1);
+    }
+
+    // sends a request, and reads the whole response
+    void Request(SOCKET client)
+    {
+        static const char request[] = "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+
+        if(send(client, request, sizeof(request) - 1, 0) != (int)sizeof(request) - 1)
+            Fail("failed to send a request");
+
+        string response;
+        char buffer[8192];
+        size_t headerSize = string::npos;
+        size_t responseSize = 0;
+
+        while(headerSize == string::npos || response.size() < responseSize)
+        {
+            int received = (int)recv(client, buffer, sizeof(buffer), 0);
+            if(received <= 0)
+                Fail("the server closed the connection");
+
+            response.append(buffer, received);
+
+            if(headerSize == string::npos && (headerSize = response.find("\r\n\r\n")) != string::npos)
+            {
+                if(response.compare(0, 15, "HTTP/1.1 200 OK") != 0)
+                    Fail("the server didn't send the file");
+
+                headerSize += 4;
+                responseSize = headerSize + FileSize;
+            }
+        }
+
+        if(response.size() != responseSize)
+            Fail("the server sent more than the response");
+    }
+
+    struct TestServer
+    {
+        HttpServer server;
+        int port;
+        SocketEngine engine;
+        atomic<Dispatcher*> dispatcher = nullptr;
+    };
+
+    // returns the pool allocations after the warm-up requests, and after the rest
+    pair<uint64_t, uint64_t> Run(int port, SocketEngine engine)
+    {
+        TestServer test;
+        test.port = port;
+        test.engine = engine;
+
+        thread serverThread([&test] {
+            test.dispatcher = &Dispatcher::current();
+            Dispatcher::current().InvokeAsync([](void* ptr, intmax_t) {
+                auto test = (TestServer*)ptr;
+                test->server.Start(test->port, docsPath, 1, test->engine);
+            }, &test);
+            Dispatcher::current().Run();
+        });
+
+        // give it time to start listening
+        this_thread::sleep_for(chrono::milliseconds(500));
+
+        SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if(connect(client, (sockaddr*)&address, sizeof(address)) != 0)
+            Fail("failed to connect to the server");
+
+        for(int i = 0; i < WarmUpRequests; ++i)
+            Request(client);
+
+        uint64_t warmCount = MemoryPool::GetAllocationCount();
+
+        for(int i = 0; i < Requests; ++i)
+            Request(client);
+
+        uint64_t finalCount = MemoryPool::GetAllocationCount();
+
+        shutdown(client, S_SHUT_RDWR);
+        close(client);
+
+        test.dispatcher.load()->InvokeAsync([](void* ptr, intmax_t) {
+            ((TestServer*)ptr)->server.Stop();
+            Dispatcher::current().Quit();
+        }, &test);
+
+        serverThread.join();
+
+        return { warmCount, finalCount };
+    }
+}
+
+int main()
+{
+    docsPath = (filesystem::temp_directory_path() / "KeepAliveAllocationTest").string();
+    filesystem::create_directories(docsPath);
+    ofstream(docsPath + "/index.html", ios::binary) << string(FileSize, 'x');
+
+    const pair<SocketEngine, const char*> engines[] = {
+        { SocketEngine::Readiness, "readiness" },
+        { SocketEngine::Completion, "completion" }
+    };
+
+    int port = Port;
+
+    for(auto [engine, name] : engines)
+    {
+        auto [warmCount, finalCount] = Run(port++, engine);
+
+        // the Completion engine falls back to Readiness where io_uring isn't available
+        if(SocketController::instance.GetEngine() != engine)
+            name = "completion (not available, readiness)";
+
+        printf("%s: pool allocations: %llu after %d requests, %llu after %d more\n", name,
+            (unsigned long long)warmCount, WarmUpRequests, (unsigned long long)finalCount, Requests);
+
+        if(finalCount != warmCount)
+            Fail("the pool kept allocating");
+    }
+
+    return 0;
+}
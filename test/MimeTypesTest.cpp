@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------------------------------
+*  Copyright (c) 2019 Nicolas Jinchereau. All rights reserved.
+*  Licensed under the MIT License. See License.txt in the project root for license information.
+*--------------------------------------------------------------------------------------------*/
+
+// Checks that MimeTypes gives the same type as the map it replaced for every extension,
+// in any case, and the default type for anything else. Exits with 1 on failure.
+// From this directory:
+//
+//   g++ -std=c++17 -O2 -I../source MimeTypesTest.cpp ../source/net/http/MimeTypes.cpp
+//       ../source/net/http/HttpFields.cpp -o MimeTypesTest
+
+#include <net/http/MimeTypes.h>
+#include "OldMimeTypes.h"
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t ExtensionCount = 983;
+
+    int failures = 0;
+
+    void Expect(string_view what, string_view actual, string_view expected)
+    {
+        if(actual != expected)
+        {
+            printf("%.*s: got \"%.*s\", expected \"%.*s\"\n",
+                (int)what.size(), what.data(), (int)actual.size(), actual.data(), (int)expected.size(), expected.data());
+            ++failures;
+        }
+    }
+}
+
+int main()
+{
+    OldMimeTypes old;
+    size_t checked = 0;
+
+    for(auto& [extension, type] : old.types)
+    {
+        // the old map's fallback entry
+        if(extension == "*")
+            continue;
+
+        string upper = extension;
+        for(char& ch : upper)
+            ch = (char)toupper((unsigned char)ch);
+
+        Expect(extension, MimeTypes::TypeFor(extension), type);
+        Expect(upper, MimeTypes::TypeFor(upper), type);
+        Expect("file." + extension, MimeTypes::TypeForPath("/docs/file." + extension), type);
+        ++checked;
+    }
+
+    if(checked != ExtensionCount) {
+        printf("the old map has %zu extensions, expected %zu\n", checked, ExtensionCount);
+        ++failures;
+    }
+
+    for(string_view extension : { "", "*", "zz", "jpgx", "jp", "html5", "a.b", "12345678901234567890" })
+        Expect(extension, MimeTypes::TypeFor(extension), MimeTypes::DefaultType);
+
+    Expect("/a/b.JPG", MimeTypes::TypeForPath("/a/b.JPG"), "image/jpeg");
+    Expect("/x/index.html", MimeTypes::TypeForPath("/x/index.html"), "text/html");
+    Expect("/a.b/file", MimeTypes::TypeForPath("/a.b/file"), MimeTypes::DefaultType);
+    Expect("noext", MimeTypes::TypeForPath("noext"), MimeTypes::DefaultType);
+    Expect("/x/file.", MimeTypes::TypeForPath("/x/file."), MimeTypes::DefaultType);
+
+    if(failures != 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+
+    printf("%zu extensions match\n", checked);
+    return 0;
+}